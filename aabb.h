@@ -0,0 +1,144 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "utilities.h"
+
+#include <algorithm>
+
+// Slab test of a ray against the box [lo, hi], shared by cube, aabb and the BVH nodes. The near
+// and far plane of each slab is picked with the ray's sign bits instead of a comparison, and
+// the ranges are combined with min/max, which also drop the NaN a zero direction produces when
+// the origin lies on a slab plane. On return [t_enter, t_exit] is the parametric range inside
+// the box (empty on a miss), and t_near/t_far hold the per-axis distances, from which
+// slab_axis() recovers the face crossed at either end.
+template <typename T>
+inline void ray_box_slabs(const ray& r, const T lo[3], const T hi[3], double t_near[3], double t_far[3],
+                          double& t_enter, double& t_exit)
+{
+	const vec3& orig = r.origin();
+	const vec3& inv_dir = r.inverse_direction();
+
+	t_enter = -infinity;
+	t_exit = infinity;
+	for (int a = 0; a < 3; a++)
+	{
+		const int s = r.direction_sign(a);
+		t_near[a] = ((s ? hi[a] : lo[a]) - orig[a]) * inv_dir[a];
+		t_far[a] = ((s ? lo[a] : hi[a]) - orig[a]) * inv_dir[a];
+		t_enter = std::max(t_enter, t_near[a]);
+		t_exit = std::min(t_exit, t_far[a]);
+	}
+}
+
+// Returns the axis whose slab distance equals t, i.e. the face the ray crosses at t.
+inline int slab_axis(const double slab_t[3], const double t)
+{
+	return slab_t[0] == t ? 0 : (slab_t[1] == t ? 1 : 2);
+}
+
+// Reduced form of ray_box_slabs for traversal: returns the distance at which the ray enters
+// the box within ray_t, or infinity if it misses the box inside that range.
+template <typename T>
+inline double ray_box_entry(const ray& r, const T lo[3], const T hi[3], const interval& ray_t)
+{
+	const vec3& orig = r.origin();
+	const vec3& inv_dir = r.inverse_direction();
+
+	double t_min = ray_t.min;
+	double t_max = ray_t.max;
+	for (int a = 0; a < 3; a++)
+	{
+		const int s = r.direction_sign(a);
+		t_min = std::max(t_min, ((s ? hi[a] : lo[a]) - orig[a]) * inv_dir[a]);
+		t_max = std::min(t_max, ((s ? lo[a] : hi[a]) - orig[a]) * inv_dir[a]);
+	}
+	return t_min <= t_max ? t_min : infinity;
+}
+
+class aabb
+{
+public:
+	interval x, y, z;
+
+	aabb()
+	{
+	} // The default AABB is empty, since intervals are empty by default.
+
+	aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z)
+	{
+	}
+
+	aabb(const vec3& a, const vec3& b)
+	{
+		// Treat the two points a and b as extrema for the bounding box, so we don't require a
+		// particular minimum/maximum coordinate order.
+		x = (a[0] <= b[0]) ? interval(a[0], b[0]) : interval(b[0], a[0]);
+		y = (a[1] <= b[1]) ? interval(a[1], b[1]) : interval(b[1], a[1]);
+		z = (a[2] <= b[2]) ? interval(a[2], b[2]) : interval(b[2], a[2]);
+	}
+
+	aabb(const aabb& box0, const aabb& box1)
+	{
+		x = interval(box0.x, box1.x);
+		y = interval(box0.y, box1.y);
+		z = interval(box0.z, box1.z);
+	}
+
+	const interval& axis_interval(const int n) const
+	{
+		if (n == 1) return y;
+		if (n == 2) return z;
+		return x;
+	}
+
+	vec3 min() const { return vec3(x.min, y.min, z.min); }
+	vec3 max() const { return vec3(x.max, y.max, z.max); }
+
+	vec3 centroid() const
+	{
+		return 0.5 * (min() + max());
+	}
+
+	bool is_empty() const
+	{
+		return x.min > x.max || y.min > y.max || z.min > z.max;
+	}
+
+	int longest_axis() const
+	{
+		// Returns the index of the longest axis of the bounding box.
+		if (x.size() > y.size())
+			return x.size() > z.size() ? 0 : 2;
+		return y.size() > z.size() ? 1 : 2;
+	}
+
+	double surface_area() const
+	{
+		if (is_empty())
+			return 0;
+
+		const auto dx = x.size();
+		const auto dy = y.size();
+		const auto dz = z.size();
+		return 2 * (dx * dy + dy * dz + dz * dx);
+	}
+
+	bool hit(const ray& r, const interval ray_t) const
+	{
+		const double lo[3] = {x.min, y.min, z.min};
+		const double hi[3] = {x.max, y.max, z.max};
+		return ray_box_entry(r, lo, hi, ray_t) != infinity;
+	}
+
+	static const aabb empty, universe;
+};
+
+const aabb aabb::empty = aabb(interval::empty, interval::empty, interval::empty);
+const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+
+inline aabb operator+(const aabb& bbox, const vec3& offset)
+{
+	return aabb(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef AFFINE_TRANSFORM_H
+#define AFFINE_TRANSFORM_H
+
+#include "aabb.h"
+
+// A 3x4 affine transform: a linear part (columns 0-2) and a translation (column 3). Points use
+// both, vectors only the linear part.
+class affine_transform
+{
+public:
+	double m[3][4];
+
+	affine_transform() : m{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}
+	{
+	} // Identity
+
+	static affine_transform translate(const vec3& offset)
+	{
+		affine_transform t;
+		for (int i = 0; i < 3; i++)
+			t.m[i][3] = offset[i];
+		return t;
+	}
+
+	static affine_transform scale(const vec3& factors)
+	{
+		affine_transform t;
+		for (int i = 0; i < 3; i++)
+			t.m[i][i] = factors[i];
+		return t;
+	}
+
+	static affine_transform rotate(const vec3& axis, const double degrees)
+	{
+		// Rodrigues' rotation formula around the unit axis.
+		const vec3 a = unit_vector(axis);
+		const auto theta = degrees_to_radians(degrees);
+		const auto c = cos(theta);
+		const auto s = sin(theta);
+		const auto k = 1 - c;
+
+		affine_transform t;
+		t.m[0][0] = a.x() * a.x() * k + c;
+		t.m[0][1] = a.x() * a.y() * k - a.z() * s;
+		t.m[0][2] = a.x() * a.z() * k + a.y() * s;
+		t.m[1][0] = a.y() * a.x() * k + a.z() * s;
+		t.m[1][1] = a.y() * a.y() * k + c;
+		t.m[1][2] = a.y() * a.z() * k - a.x() * s;
+		t.m[2][0] = a.z() * a.x() * k - a.y() * s;
+		t.m[2][1] = a.z() * a.y() * k + a.x() * s;
+		t.m[2][2] = a.z() * a.z() * k + c;
+		return t;
+	}
+
+	// Composition: (a * b) applies b first, then a.
+	affine_transform operator*(const affine_transform& b) const
+	{
+		affine_transform t;
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				t.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+			}
+			t.m[i][3] += m[i][3];
+		}
+		return t;
+	}
+
+	affine_transform inverse() const
+	{
+		// Invert the linear part through its adjugate, then map the translation back.
+		const double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+			- m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+			+ m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+		const double inv_det = 1.0 / det;
+
+		affine_transform t;
+		t.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+		t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+		t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+		t.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+		t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+		t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+		t.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+		t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+		t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+		for (int i = 0; i < 3; i++)
+			t.m[i][3] = -(t.m[i][0] * m[0][3] + t.m[i][1] * m[1][3] + t.m[i][2] * m[2][3]);
+		return t;
+	}
+
+	vec3 point(const vec3& p) const
+	{
+		return vector(p) + vec3(m[0][3], m[1][3], m[2][3]);
+	}
+
+	vec3 vector(const vec3& v) const
+	{
+		return vec3(m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+		            m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+		            m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]);
+	}
+
+	// Multiplies by the transpose of the linear part. Normals transform with the inverse
+	// transpose, so calling this on the inverse transform maps normals forward.
+	vec3 transposed_vector(const vec3& v) const
+	{
+		return vec3(m[0][0] * v[0] + m[1][0] * v[1] + m[2][0] * v[2],
+		            m[0][1] * v[0] + m[1][1] * v[1] + m[2][1] * v[2],
+		            m[0][2] * v[0] + m[1][2] * v[1] + m[2][2] * v[2]);
+	}
+
+	aabb box(const aabb& b) const
+	{
+		// Bounds of the eight transformed corners. Unbounded boxes stay unbounded.
+		for (int a = 0; a < 3; a++)
+		{
+			if (std::isinf(b.axis_interval(a).min) || std::isinf(b.axis_interval(a).max))
+				return b.is_empty() ? aabb::empty : aabb::universe;
+		}
+
+		aabb result;
+		for (int i = 0; i < 8; i++)
+		{
+			const vec3 corner(i & 1 ? b.x.max : b.x.min, i & 2 ? b.y.max : b.y.min, i & 4 ? b.z.max : b.z.min);
+			const vec3 p = point(corner);
+			result = aabb(result, aabb(p, p));
+		}
+		return result;
+	}
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "utilities.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator. Objects are carved out of large blocks one after the other and are never
+// freed individually: reset() destroys everything at once and rewinds the arena (keeping its
+// blocks for reuse), and the destructor also returns the memory. Not thread-safe; use one arena
+// per thread, e.g. scratch_arena() below.
+class arena
+{
+public:
+	explicit arena(const size_t block_size = 1 << 20) : block_size(block_size)
+	{
+	}
+
+	~arena()
+	{
+		reset();
+	}
+
+	arena(const arena&) = delete;
+	arena& operator=(const arena&) = delete;
+
+	void* allocate(const size_t size, const size_t alignment = alignof(std::max_align_t))
+	{
+		while (true)
+		{
+			if (current < blocks.size())
+			{
+				block& b = blocks[current];
+				const auto base = reinterpret_cast<uintptr_t>(b.data.get());
+				const uintptr_t aligned = (base + offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+				if (aligned + size <= base + b.size)
+				{
+					offset = aligned + size - base;
+					used += size;
+					return reinterpret_cast<void*>(aligned);
+				}
+
+				// Doesn't fit: move on to the next block, if any.
+				if (current + 1 < blocks.size())
+				{
+					current++;
+					offset = 0;
+					continue;
+				}
+			}
+
+			const size_t needed = size + alignment;
+			blocks.push_back({std::make_unique<unsigned char[]>(needed > block_size ? needed : block_size),
+			                  needed > block_size ? needed : block_size});
+			reserved += blocks.back().size;
+			current = blocks.size() - 1;
+			offset = 0;
+		}
+	}
+
+	// Constructs a T in the arena. Its destructor runs on reset() or when the arena goes away.
+	template <typename T, typename... Args>
+	T* create(Args&&... args)
+	{
+		T* object = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value)
+		{
+			auto* entry = new(allocate(sizeof(destructor_entry), alignof(destructor_entry))) destructor_entry;
+			entry->destroy = [](void* p) { static_cast<T*>(p)->~T(); };
+			entry->object = object;
+			entry->next = destructors;
+			destructors = entry;
+		}
+		return object;
+	}
+
+	// Like create(), but returns a shared_ptr that plugs into the existing scene API
+	// (hittable_list::add, materials held by primitives). The pointer doesn't own the object and
+	// has no control block, so copying it is free; the arena must outlive every copy.
+	template <typename T, typename... Args>
+	shared_ptr<T> make(Args&&... args)
+	{
+		return shared_ptr<T>(shared_ptr<T>(), create<T>(std::forward<Args>(args)...));
+	}
+
+	// Destroys every object and rewinds to the first block.
+	void reset()
+	{
+		// Objects are destroyed in reverse order of construction.
+		for (auto* entry = destructors; entry; entry = entry->next)
+			entry->destroy(entry->object);
+		destructors = nullptr;
+		current = 0;
+		offset = 0;
+		used = 0;
+	}
+
+	size_t bytes_used() const { return used; }
+	size_t bytes_reserved() const { return reserved; }
+
+private:
+	struct block
+	{
+		std::unique_ptr<unsigned char[]> data;
+		size_t size;
+	};
+
+	struct destructor_entry
+	{
+		void (*destroy)(void*);
+		void* object;
+		destructor_entry* next;
+	};
+
+	size_t block_size;
+	std::vector<block> blocks;
+	size_t current = 0; // Block being filled
+	size_t offset = 0; // Fill level of the current block
+	size_t used = 0;
+	size_t reserved = 0;
+	destructor_entry* destructors = nullptr;
+};
+
+// Per-thread arena for transient render data. Whoever uses it resets it when done.
+inline arena& scratch_arena()
+{
+	thread_local arena scratch(64 << 10);
+	return scratch;
+}
+
+#endif
@@ -0,0 +1,298 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "utilities.h"
+#include "arena.h"
+#include "hittable_list.h"
+#include "bvh_list.h"
+#include "bvh_wide.h"
+#include "material.h"
+#include "sphere.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+// Resident memory of this process in bytes, or 0 where it can't be queried.
+inline size_t process_resident_bytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.WorkingSetSize;
+	return 0;
+#elif defined(__linux__)
+	size_t pages = 0, resident = 0;
+	if (std::FILE* f = std::fopen("/proc/self/statm", "r"))
+	{
+		if (std::fscanf(f, "%zu %zu", &pages, &resident) != 2)
+			resident = 0;
+		std::fclose(f);
+	}
+	return resident * 4096;
+#else
+	return 0;
+#endif
+}
+
+// Allocator that tallies the bytes it hands out, used to measure what make_shared costs: with
+// allocate_shared the object and its control block go through it exactly as with make_shared.
+template <typename T>
+struct counting_allocator
+{
+	using value_type = T;
+
+	size_t* total;
+
+	explicit counting_allocator(size_t* total) : total(total)
+	{
+	}
+
+	template <typename U>
+	counting_allocator(const counting_allocator<U>& other) : total(other.total)
+	{
+	}
+
+	T* allocate(const size_t n)
+	{
+		*total += n * sizeof(T);
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* p, const size_t n)
+	{
+		std::allocator<T>().deallocate(p, n);
+	}
+
+	template <typename U>
+	bool operator==(const counting_allocator<U>& other) const { return total == other.total; }
+
+	template <typename U>
+	bool operator!=(const counting_allocator<U>& other) const { return total != other.total; }
+};
+
+// Builds a scene of `count` spheres, each with its own material, once with make_shared and
+// once in an arena, and reports construction time, teardown time and memory for both. Memory is
+// the heap requested for primitives and materials (the object list itself is the same for both).
+inline void run_arena_benchmark(const size_t count)
+{
+	using clock = std::chrono::steady_clock;
+	auto seconds = [](const clock::time_point a, const clock::time_point b)
+	{
+		return std::chrono::duration<double>(b - a).count();
+	};
+	auto report = [&](const char* name, const double build, const double teardown, const size_t bytes)
+	{
+		std::clog << std::left << std::setw(12) << name << std::fixed << std::setprecision(3)
+			<< "build " << build << "s, teardown " << teardown << "s, memory "
+			<< std::setprecision(1) << bytes / (1024.0 * 1024.0) << " MiB ("
+			<< static_cast<double>(bytes) / count << " bytes/object)\n";
+	};
+
+	std::clog << "Scene construction benchmark, " << count << " spheres with one material each\n";
+
+	{
+		size_t bytes = 0;
+		const auto start = clock::now();
+		auto world = std::make_unique<hittable_list>();
+		world->objects.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			auto mat = std::allocate_shared<lambertian>(counting_allocator<lambertian>(&bytes), color(0.5, 0.5, 0.5));
+			world->add(std::allocate_shared<sphere>(counting_allocator<sphere>(&bytes),
+			                                        vec3(static_cast<double>(i), 0, 0), 0.5, mat));
+		}
+		const auto built = clock::now();
+		world.reset();
+		report("shared_ptr", seconds(start, built), seconds(built, clock::now()), bytes);
+	}
+
+	{
+		const auto start = clock::now();
+		auto scene_arena = std::make_unique<arena>(16 << 20);
+		auto world = std::make_unique<hittable_list>();
+		world->objects.reserve(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			auto mat = scene_arena->make<lambertian>(color(0.5, 0.5, 0.5));
+			world->add(scene_arena->make<sphere>(vec3(static_cast<double>(i), 0, 0), 0.5, mat));
+		}
+		const auto built = clock::now();
+		const size_t bytes = scene_arena->bytes_reserved();
+		world.reset();
+		scene_arena.reset();
+		report("arena", seconds(start, built), seconds(built, clock::now()), bytes);
+	}
+}
+
+// Animates `count` spheres for a number of frames, moving a fraction of them by a random step
+// each frame, and compares bvh_list::update with building the tree from scratch. At the end the
+// refitted tree is checked against a fresh one with random rays.
+inline void run_refit_benchmark(const size_t count)
+{
+	using clock = std::chrono::steady_clock;
+	auto seconds = [](const clock::time_point a, const clock::time_point b)
+	{
+		return std::chrono::duration<double>(b - a).count();
+	};
+	constexpr int frames = 30;
+
+	std::clog << "Scene update benchmark, " << count << " spheres, " << frames << " frames\n";
+
+	const double side = 2 * std::cbrt(static_cast<double>(count));
+	auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+	hittable_list list;
+	std::vector<shared_ptr<sphere>> spheres;
+	std::vector<vec3> centers;
+	for (size_t i = 0; i < count; i++)
+	{
+		centers.push_back(vec3::random(0, side));
+		spheres.push_back(make_shared<sphere>(centers.back(), 0.4, mat));
+		list.add(spheres.back());
+	}
+
+	auto start = clock::now();
+	bvh_list fresh(list);
+	const double build_time = seconds(start, clock::now());
+	std::clog << std::fixed << std::setprecision(2) << "full build   " << build_time * 1000 << " ms, SAH cost "
+		<< fresh.sah_cost() << "\n";
+
+	for (const double fraction : {0.001, 0.01, 0.1, 1.0})
+	{
+		bvh_list animated(list);
+		const auto moved = std::max<size_t>(1, static_cast<size_t>(fraction * count));
+		std::vector<size_t> changed(moved);
+		double update_time = 0;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (auto& index : changed)
+			{
+				index = static_cast<size_t>(random_double() * count);
+				centers[index] += vec3::random(-0.5, 0.5);
+				spheres[index]->place(centers[index], 0.4);
+			}
+			start = clock::now();
+			animated.update(changed);
+			update_time += seconds(start, clock::now());
+		}
+
+		std::clog << std::setprecision(1) << std::setw(5) << fraction * 100 << "% moved  update "
+			<< std::setprecision(3) << update_time / frames * 1000 << " ms/frame ("
+			<< std::setprecision(1) << 100 * update_time / frames / build_time << "% of a build), "
+			<< animated.rebuild_count() << " rebuilds, SAH cost " << std::setprecision(2) << animated.sah_cost()
+			<< " vs " << bvh_list(list).sah_cost() << " rebuilt\n";
+
+		// The refitted tree must find exactly what a fresh one finds.
+		const bvh_list reference(list);
+		int mismatches = 0;
+		for (int i = 0; i < 20000; i++)
+		{
+			const ray r(vec3::random(0, side), random_unit_vector());
+			hit_record a, b;
+			const bool hit_a = animated.hit(r, interval(0.001, infinity), a);
+			const bool hit_b = reference.hit(r, interval(0.001, infinity), b);
+			if (hit_a != hit_b || (hit_a && a.t != b.t) || animated.occluded(r, interval(0.001, 10)) != reference.occluded(r, interval(0.001, 10)))
+				mismatches++;
+		}
+		if (mismatches > 0)
+			std::cerr << mismatches << " of 20000 rays differ from a freshly built tree\n";
+	}
+}
+
+// Builds BVHs over `count` random spheres with each builder, on one thread and on all of them,
+// and reports build time against the quality of the tree: its SAH cost and how fast it traces.
+inline void run_build_benchmark(const size_t count)
+{
+	using clock = std::chrono::steady_clock;
+	const unsigned hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::clog << "BVH build benchmark, " << count << " spheres, " << hardware_threads << " hardware threads\n";
+
+	const double side = 2 * std::cbrt(static_cast<double>(count));
+	auto mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+	std::vector<sphere> spheres;
+	std::vector<bvh_bounds> bounds;
+	spheres.reserve(count);
+	bounds.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		spheres.emplace_back(vec3::random(0, side), random_double(0.2, 0.6), mat);
+		bounds.push_back(bvh_bounds::from(spheres.back().bounding_box()));
+	}
+
+	std::vector<ray> rays;
+	for (int i = 0; i < 200000; i++)
+		rays.emplace_back(vec3::random(0, side), random_unit_vector());
+
+	// Seconds per ray, the best of two passes, and number of hits for one of the trees.
+	auto trace = [&](const auto& tree, const std::vector<uint32_t>& indices, size_t& hits)
+	{
+		double best = infinity;
+		for (int pass = 0; pass < 2; pass++)
+		{
+			const auto start = clock::now();
+			hits = 0;
+			for (const ray& r : rays)
+			{
+				hit_record rec;
+				hits += tree.closest_hit(r, interval(0.001, infinity), [&](const uint32_t i, interval& t)
+				{
+					if (!spheres[indices[i]].hit(r, t, rec))
+						return false;
+					t.max = rec.t;
+					return true;
+				});
+			}
+			best = std::min(best, std::chrono::duration<double>(clock::now() - start).count());
+		}
+		return best / rays.size();
+	};
+
+	for (const bvh_builder builder : {bvh_builder::sah, bvh_builder::lbvh})
+	{
+		for (const unsigned threads : {1u, hardware_threads})
+		{
+			bvh_tree tree;
+			tree.thread_count = threads;
+			const auto start = clock::now();
+			tree.build(bounds, 4, builder);
+			const double build_time = std::chrono::duration<double>(clock::now() - start).count();
+
+			size_t hits;
+			const double trace_time = trace(tree, tree.indices, hits);
+
+			std::clog << (builder == bvh_builder::sah ? "SAH " : "LBVH") << std::setw(4) << threads << " threads  build "
+				<< std::fixed << std::setprecision(1) << std::setw(7) << build_time * 1000 << " ms, SAH cost "
+				<< std::setprecision(2) << tree.sah_cost() << ", trace " << std::setprecision(0)
+				<< trace_time * 1e9 << " ns/ray (" << hits << " hits)\n";
+			if (threads == hardware_threads)
+				break;
+		}
+	}
+
+	// The SAH tree again, collapsed to four and eight children per node.
+	bvh_tree tree;
+	tree.build(bounds, 4);
+	auto report_wide = [&](const char* name, const auto& wide, const double collapse_time)
+	{
+		size_t hits;
+		const double trace_time = trace(wide, tree.indices, hits);
+		std::clog << name << "       collapse " << std::setprecision(1) << std::setw(7) << collapse_time * 1000
+			<< " ms, " << wide.nodes.size() << " nodes, trace " << std::setprecision(0) << trace_time * 1e9
+			<< " ns/ray (" << hits << " hits)\n";
+	};
+	auto start = clock::now();
+	const bvh_wide<4> wide4(tree);
+	report_wide("SAH BVH4", wide4, std::chrono::duration<double>(clock::now() - start).count());
+	start = clock::now();
+	const bvh_wide<8> wide8(tree);
+	report_wide("SAH BVH8", wide8, std::chrono::duration<double>(clock::now() - start).count());
+}
+
+#endif
@@ -0,0 +1,890 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "aabb.h"
+#include "memory_report.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+// Axis-aligned bounds stored in single precision. Conversions from double round outward, so a
+// float box always contains the double box it was made from.
+struct bvh_bounds
+{
+	float min[3] = {+std::numeric_limits<float>::infinity(), +std::numeric_limits<float>::infinity(),
+	                +std::numeric_limits<float>::infinity()};
+	float max[3] = {-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+	                -std::numeric_limits<float>::infinity()};
+
+	static float round_down(const double x)
+	{
+		const auto f = static_cast<float>(x);
+		return f > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+	}
+
+	static float round_up(const double x)
+	{
+		const auto f = static_cast<float>(x);
+		return f < x ? std::nextafter(f, +std::numeric_limits<float>::infinity()) : f;
+	}
+
+	static bvh_bounds from(const aabb& box)
+	{
+		bvh_bounds b;
+		for (int a = 0; a < 3; a++)
+		{
+			b.min[a] = round_down(box.axis_interval(a).min);
+			b.max[a] = round_up(box.axis_interval(a).max);
+		}
+		return b;
+	}
+
+	void grow(const bvh_bounds& b)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			min[a] = std::min(min[a], b.min[a]);
+			max[a] = std::max(max[a], b.max[a]);
+		}
+	}
+
+	void grow(const float p[3])
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			min[a] = std::min(min[a], p[a]);
+			max[a] = std::max(max[a], p[a]);
+		}
+	}
+
+	float centroid(const int a) const { return 0.5f * (min[a] + max[a]); }
+
+	float surface_area() const
+	{
+		const float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+		if (dx < 0 || dy < 0 || dz < 0)
+			return 0;
+		return 2 * (dx * dy + dy * dz + dz * dx);
+	}
+
+	aabb to_aabb() const
+	{
+		return aabb(interval(min[0], max[0]), interval(min[1], max[1]), interval(min[2], max[2]));
+	}
+};
+
+// A node of a flattened bounding volume hierarchy, 32 bytes so two nodes share a cache line.
+// Interior nodes keep their left child right after them and store the index of the right
+// child in `offset`. Leaves store the position of their first primitive in `offset` and a
+// non-zero primitive `count`.
+struct bvh_node
+{
+	bvh_bounds bounds;
+	uint32_t offset = 0;
+	uint32_t count = 0;
+
+	bool is_leaf() const { return count > 0; }
+};
+
+// How a bvh_tree picks its splits. SAH bins primitives along the widest axis and minimizes the
+// surface area heuristic, for the best trees. LBVH sorts the primitives along a Morton curve and
+// splits where the codes do, several times faster to build but with a worse tree to trace.
+enum class bvh_builder
+{
+	sah,
+	lbvh
+};
+
+// Index-based BVH over an arbitrary set of primitives. The tree only knows primitive bounds;
+// callers intersect the primitives themselves through the callback passed to closest_hit or
+// any_hit, which receives positions into `indices`.
+//
+// Trees over moving primitives keep every node's bounds at time 0 in the node and at time 1 in
+// end_bounds, and test a ray against their interpolation at the ray's time. Linear motion keeps
+// each primitive inside that interpolation, so a blurred object costs about as much to cull as
+// a still one, not as much as the box of its whole sweep.
+//
+// Large trees are built in parallel: the top few levels are split on the calling thread and
+// the subtrees below them built as separate tasks, then spliced into one array. The result
+// doesn't depend on the number of threads.
+//
+// When primitives change, refit() moves the node bounds to follow them without touching the
+// topology. The tree keeps track of its SAH cost as it goes; once that has grown past
+// rebuild_threshold times the cost it was built with, needs_rebuild() says so.
+class bvh_tree
+{
+public:
+	std::vector<bvh_node> nodes;
+	std::vector<uint32_t> indices; // Primitive indices, in leaf order
+	std::vector<bvh_bounds> end_bounds; // Node bounds at time 1; empty when nothing moves
+	double rebuild_threshold = 1.5;
+	unsigned thread_count = 0; // Threads for builds and refits; 0 uses every hardware thread
+
+	void build(const std::vector<bvh_bounds>& prim_bounds, const int max_leaf_size = 4,
+	           const bvh_builder builder = bvh_builder::sah)
+	{
+		nodes.clear();
+		end_bounds.clear();
+		parents.clear();
+		leaf_of.clear();
+		indices.resize(prim_bounds.size());
+		std::iota(indices.begin(), indices.end(), 0u);
+		primitive_count = static_cast<uint32_t>(prim_bounds.size());
+		cost_sum = built_cost = 0;
+
+		if (prim_bounds.empty())
+			return;
+
+		const unsigned threads = prim_bounds.size() < parallel_build_prims ? 1u : worker_count();
+		if (builder == bvh_builder::lbvh)
+		{
+			const std::vector<uint32_t> codes = sort_by_morton(prim_bounds, threads);
+			auto split = [&](const uint32_t begin, const uint32_t end, const int depth)
+			{
+				return morton_split(codes, begin, end, depth);
+			};
+			build_tree(prim_bounds, max_leaf_size, threads, split);
+		}
+		else
+		{
+			auto split = [&](const uint32_t begin, const uint32_t end, const int depth)
+			{
+				return sah_split(prim_bounds, begin, end, depth);
+			};
+			build_tree(prim_bounds, max_leaf_size, threads, split);
+		}
+
+		for (uint32_t i = 0; i < nodes.size(); i++)
+			cost_sum += node_cost(i);
+		built_cost = sah_cost();
+	}
+
+	// Builds over primitives moving from `start` (time 0) to `end` (time 1). Splits are chosen
+	// on the bounds of the whole sweep; then every node is fitted to its primitives at both ends.
+	void build_motion(const std::vector<bvh_bounds>& start, const std::vector<bvh_bounds>& end,
+	                  const int max_leaf_size = 4, const bvh_builder builder = bvh_builder::sah)
+	{
+		std::vector<bvh_bounds> swept(start);
+		for (size_t i = 0; i < swept.size(); i++)
+			swept[i].grow(end[i]);
+		build(swept, max_leaf_size, builder);
+
+		if (nodes.empty())
+			return;
+		end_bounds.resize(nodes.size());
+		refit_all([&](const uint32_t i, bvh_bounds& s, bvh_bounds& e)
+		{
+			s = start[indices[i]];
+			e = end[indices[i]];
+		});
+		built_cost = sah_cost();
+	}
+
+	// Refits the nodes above the primitives at leaf positions `changed` (the positions the
+	// intersect callbacks receive). `bounds_of(i, start, end)` gives the current bounds of the
+	// primitive at position i at time 0 and time 1, equal for primitives that don't move; trees
+	// built without motion bound the whole sweep. Only the changed leaves and their ancestors
+	// are visited, unless so much changed that refitting everything in parallel is cheaper:
+	// fetching the bounds of every primitive is what a full refit costs, so that takes a change
+	// to about half of the primitives per thread.
+	template <typename Bounds>
+	void refit(const std::vector<uint32_t>& changed, Bounds&& bounds_of)
+	{
+		if (changed.empty() || nodes.empty())
+			return;
+		if (changed.size() > primitive_count / (2 * refit_threads()))
+		{
+			refit_all(bounds_of);
+			return;
+		}
+
+		if (parents.empty())
+		{
+			// Links up the tree, built on the first partial refit: static scenes never pay for them.
+			parents.assign(nodes.size(), 0);
+			leaf_of.assign(primitive_count, 0);
+			marked.assign(nodes.size(), 0);
+			for (uint32_t i = 0; i < nodes.size(); i++)
+			{
+				const bvh_node& node = nodes[i];
+				if (node.is_leaf())
+				{
+					for (uint32_t p = node.offset; p < node.offset + node.count; p++)
+						leaf_of[p] = i;
+				}
+				else
+					parents[i + 1] = parents[node.offset] = i;
+			}
+		}
+
+		// Children come after their parents, so refitting in decreasing index order is bottom-up.
+		std::vector<uint32_t> dirty;
+		for (const uint32_t position : changed)
+		{
+			for (uint32_t i = leaf_of[position]; !marked[i]; i = parents[i])
+			{
+				marked[i] = 1;
+				dirty.push_back(i);
+				if (i == 0)
+					break;
+			}
+		}
+		std::sort(dirty.begin(), dirty.end(), std::greater<uint32_t>());
+		for (const uint32_t i : dirty)
+		{
+			cost_sum -= node_cost(i);
+			fit_node(i, bounds_of);
+			cost_sum += node_cost(i);
+			marked[i] = 0;
+		}
+	}
+
+	// Refits every node, splitting the tree into subtrees refitted on separate threads.
+	template <typename Bounds>
+	void refit_all(Bounds&& bounds_of)
+	{
+		if (nodes.empty())
+			return;
+
+		const unsigned refit_thread_count = refit_threads();
+
+		// Expand the top of the tree until there are a few subtrees per thread. Each subtree
+		// occupies the node range [root, subtree_end(root)).
+		std::vector<uint32_t> roots{0}, top;
+		while (refit_thread_count > 1 && roots.size() < 4 * refit_thread_count && roots.size() < nodes.size() / 2)
+		{
+			std::vector<uint32_t> next;
+			for (const uint32_t i : roots)
+			{
+				if (nodes[i].is_leaf())
+					next.push_back(i);
+				else
+				{
+					top.push_back(i);
+					next.push_back(i + 1);
+					next.push_back(nodes[i].offset);
+				}
+			}
+			if (next.size() == roots.size())
+				break;
+			roots.swap(next);
+		}
+
+		std::vector<double> costs(roots.size(), 0.0);
+		std::atomic<size_t> next_root{0};
+		auto worker = [&]
+		{
+			for (size_t r; (r = next_root.fetch_add(1)) < roots.size();)
+			{
+				for (uint32_t i = subtree_end(roots[r]); i-- > roots[r];)
+				{
+					fit_node(i, bounds_of);
+					costs[r] += node_cost(i);
+				}
+			}
+		};
+		if (refit_thread_count == 1)
+			worker();
+		else
+		{
+			std::vector<std::thread> threads;
+			for (unsigned t = 0; t < std::min<size_t>(refit_thread_count, roots.size()); t++)
+				threads.emplace_back(worker);
+			for (auto& thread : threads)
+				thread.join();
+		}
+
+		cost_sum = std::accumulate(costs.begin(), costs.end(), 0.0);
+		std::sort(top.begin(), top.end(), std::greater<uint32_t>());
+		for (const uint32_t i : top)
+		{
+			fit_node(i, bounds_of);
+			cost_sum += node_cost(i);
+		}
+	}
+
+	// SAH cost of the tree: the expected number of node visits and primitive tests for a ray
+	// through the root, from the node areas relative to the root's.
+	double sah_cost() const
+	{
+		const double root_area = nodes.empty() ? 0.0 : node_area(0);
+		return root_area > 0 ? cost_sum / root_area : 0.0;
+	}
+
+	bool needs_rebuild() const { return sah_cost() > rebuild_threshold * built_cost; }
+
+	size_t memory_bytes() const
+	{
+		return vector_bytes(nodes) + vector_bytes(indices) + vector_bytes(end_bounds) + vector_bytes(parents)
+			+ vector_bytes(leaf_of) + vector_bytes(marked);
+	}
+
+	// Frees the tree, for owners that trace a collapsed copy and can do without refitting.
+	void release()
+	{
+		*this = bvh_tree();
+	}
+
+	bool empty() const { return nodes.empty(); }
+
+	aabb bounding_box() const
+	{
+		if (empty())
+			return aabb::empty;
+		return end_bounds.empty() ? nodes[0].bounds.to_aabb() : aabb(nodes[0].bounds.to_aabb(), end_bounds[0].to_aabb());
+	}
+
+	// Bounds of the whole tree at time 0 and time 1.
+	void motion_bounds(aabb& start, aabb& end) const
+	{
+		if (empty())
+		{
+			start = end = aabb::empty;
+			return;
+		}
+		start = nodes[0].bounds.to_aabb();
+		end = end_bounds.empty() ? start : end_bounds[0].to_aabb();
+	}
+
+	// Finds the closest primitive hit. `intersect(i, ray_t)` tests primitive slot i and, on a
+	// hit, returns true after shrinking ray_t.max to the hit distance.
+	template <typename Intersect>
+	bool closest_hit(const ray& r, interval ray_t, Intersect&& intersect) const
+	{
+		return end_bounds.empty() ? traverse<false, false>(r, ray_t, intersect)
+			: traverse<false, true>(r, ray_t, intersect);
+	}
+
+	// Returns as soon as `intersect(i, ray_t)` reports any hit.
+	template <typename Intersect>
+	bool any_hit(const ray& r, const interval ray_t, Intersect&& intersect) const
+	{
+		return end_bounds.empty() ? traverse<true, false>(r, ray_t, intersect)
+			: traverse<true, true>(r, ray_t, intersect);
+	}
+
+private:
+	static constexpr int bin_count = 16;
+	static constexpr int stack_size = 64;
+
+	// Past this depth the builder only makes even splits, which bounds the total depth (and so
+	// the traversal stack) by max_sah_depth + 32 for any 32-bit primitive count.
+	static constexpr int max_sah_depth = stack_size - 32;
+
+	// Below this many nodes (primitives) a refit (build) is quicker than starting threads for it.
+	static constexpr size_t parallel_refit_nodes = 1 << 16;
+	static constexpr size_t parallel_build_prims = 1 << 15;
+
+	// Ranges this small are built in one piece even above the spawn depth.
+	static constexpr uint32_t min_task_size = 4096;
+
+	uint32_t primitive_count = 0;
+	double cost_sum = 0; // Sum of node_cost over all nodes
+	double built_cost = 0; // sah_cost() right after the last build
+
+	// For partial refits, built on first use.
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> leaf_of; // Leaf holding each primitive position
+	std::vector<uint8_t> marked;
+
+	template <typename Split>
+	void build_tree(const std::vector<bvh_bounds>& prim_bounds, const int max_leaf_size, const unsigned threads,
+	                Split& split)
+	{
+		const auto count = static_cast<uint32_t>(prim_bounds.size());
+		if (threads == 1)
+		{
+			nodes.reserve(2 * prim_bounds.size() - 1);
+			build_range(nodes, prim_bounds, 0, count, max_leaf_size, 0, split);
+			nodes.shrink_to_fit();
+			return;
+		}
+
+		// A few subtrees per thread.
+		int spawn_depth = 0;
+		while ((1u << spawn_depth) < 4 * threads)
+			spawn_depth++;
+
+		build_fragment root;
+		build_fragment_range(root, prim_bounds, 0, count, max_leaf_size, 0, spawn_depth, split);
+		nodes.reserve(2 * prim_bounds.size() - 1);
+		emit(root);
+		nodes.shrink_to_fit();
+	}
+
+	// Builds the subtree over positions [begin, end) of `indices` into `out`, in depth-first
+	// order. `split(begin, end, depth)` reorders the range and returns where its halves meet.
+	template <typename Split>
+	uint32_t build_range(std::vector<bvh_node>& out, const std::vector<bvh_bounds>& prim_bounds,
+	                     const uint32_t begin, const uint32_t end, const int max_leaf_size, const int depth,
+	                     Split& split)
+	{
+		const auto node_index = static_cast<uint32_t>(out.size());
+		out.emplace_back();
+
+		if (end - begin <= static_cast<uint32_t>(max_leaf_size))
+		{
+			bvh_node& leaf = out[node_index];
+			for (uint32_t i = begin; i < end; i++)
+				leaf.bounds.grow(prim_bounds[indices[i]]);
+			leaf.offset = begin;
+			leaf.count = end - begin;
+			return node_index;
+		}
+
+		const uint32_t mid = split(begin, end, depth);
+		build_range(out, prim_bounds, begin, mid, max_leaf_size, depth + 1, split);
+		const uint32_t right = build_range(out, prim_bounds, mid, end, max_leaf_size, depth + 1, split);
+		bvh_node& node = out[node_index];
+		node.bounds = out[node_index + 1].bounds;
+		node.bounds.grow(out[right].bounds);
+		node.offset = right;
+		node.count = 0;
+		return node_index;
+	}
+
+	// Part of a tree built in parallel: either a subtree built in one piece by build_range, or a
+	// node whose two halves were built on separate threads.
+	struct build_fragment
+	{
+		std::vector<bvh_node> nodes;
+		bvh_bounds bounds;
+		std::unique_ptr<build_fragment> left, right;
+	};
+
+	template <typename Split>
+	void build_fragment_range(build_fragment& fragment, const std::vector<bvh_bounds>& prim_bounds,
+	                          const uint32_t begin, const uint32_t end, const int max_leaf_size, const int depth,
+	                          const int spawn_depth, Split& split)
+	{
+		if (depth >= spawn_depth || end - begin <= min_task_size)
+		{
+			build_range(fragment.nodes, prim_bounds, begin, end, max_leaf_size, depth, split);
+			fragment.bounds = fragment.nodes[0].bounds;
+			return;
+		}
+
+		const uint32_t mid = split(begin, end, depth);
+		fragment.left = std::make_unique<build_fragment>();
+		fragment.right = std::make_unique<build_fragment>();
+		std::thread right([&]
+		{
+			build_fragment_range(*fragment.right, prim_bounds, mid, end, max_leaf_size, depth + 1, spawn_depth, split);
+		});
+		build_fragment_range(*fragment.left, prim_bounds, begin, mid, max_leaf_size, depth + 1, spawn_depth, split);
+		right.join();
+		fragment.bounds = fragment.left->bounds;
+		fragment.bounds.grow(fragment.right->bounds);
+	}
+
+	// Appends a fragment to `nodes` in depth-first order, moving child links to their new place.
+	void emit(const build_fragment& fragment)
+	{
+		const auto base = static_cast<uint32_t>(nodes.size());
+		if (!fragment.left)
+		{
+			for (bvh_node node : fragment.nodes)
+			{
+				if (!node.is_leaf())
+					node.offset += base;
+				nodes.push_back(node);
+			}
+			return;
+		}
+
+		nodes.emplace_back();
+		nodes[base].bounds = fragment.bounds;
+		emit(*fragment.left);
+		nodes[base].offset = static_cast<uint32_t>(nodes.size());
+		emit(*fragment.right);
+	}
+
+	// Binned surface area heuristic split.
+	uint32_t sah_split(const std::vector<bvh_bounds>& prim_bounds, const uint32_t begin, const uint32_t end,
+	                   const int depth)
+	{
+		bvh_bounds centroid_bounds;
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const auto& b = prim_bounds[indices[i]];
+			const float c[3] = {b.centroid(0), b.centroid(1), b.centroid(2)};
+			centroid_bounds.grow(c);
+		}
+		const uint32_t count = end - begin;
+
+		// Split along the axis with the widest centroid spread.
+		int axis = 0;
+		for (int a = 1; a < 3; a++)
+		{
+			if (centroid_bounds.max[a] - centroid_bounds.min[a] > centroid_bounds.max[axis] - centroid_bounds.min[axis])
+				axis = a;
+		}
+		const float cmin = centroid_bounds.min[axis];
+		const float extent = centroid_bounds.max[axis] - cmin;
+
+		uint32_t mid = begin;
+		if (extent > 0 && depth < max_sah_depth)
+		{
+			const float scale = bin_count / extent;
+			auto bin_of = [&](const uint32_t prim)
+			{
+				const int b = static_cast<int>((prim_bounds[prim].centroid(axis) - cmin) * scale);
+				return b < bin_count - 1 ? b : bin_count - 1;
+			};
+
+			bvh_bounds bin_bounds[bin_count];
+			uint32_t bin_counts[bin_count] = {};
+			for (uint32_t i = begin; i < end; i++)
+			{
+				const int b = bin_of(indices[i]);
+				bin_bounds[b].grow(prim_bounds[indices[i]]);
+				bin_counts[b]++;
+			}
+
+			float right_area[bin_count];
+			bvh_bounds acc;
+			for (int b = bin_count - 1; b > 0; b--)
+			{
+				acc.grow(bin_bounds[b]);
+				right_area[b] = acc.surface_area();
+			}
+
+			int best_split = 1;
+			float best_cost = std::numeric_limits<float>::infinity();
+			bvh_bounds left;
+			uint32_t left_count = 0;
+			for (int b = 1; b < bin_count; b++)
+			{
+				left.grow(bin_bounds[b - 1]);
+				left_count += bin_counts[b - 1];
+				const float cost = left_count * left.surface_area() + (count - left_count) * right_area[b];
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_split = b;
+				}
+			}
+
+			mid = static_cast<uint32_t>(
+				std::partition(indices.begin() + begin, indices.begin() + end,
+				               [&](const uint32_t prim) { return bin_of(prim) < best_split; })
+				- indices.begin());
+		}
+
+		if (mid == begin || mid == end)
+		{
+			// No usable SAH split (all centroids in one bin, or too deep): split evenly by count.
+			mid = begin + count / 2;
+			std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+			                 [&](const uint32_t a, const uint32_t b)
+			                 {
+				                 return prim_bounds[a].centroid(axis) < prim_bounds[b].centroid(axis);
+			                 });
+		}
+		return mid;
+	}
+
+	// Sorts `indices` along the Morton curve through the primitives' centroids and returns each
+	// position's 30-bit code (10 bits per axis).
+	std::vector<uint32_t> sort_by_morton(const std::vector<bvh_bounds>& prim_bounds, const unsigned threads)
+	{
+		const size_t count = prim_bounds.size();
+		std::vector<bvh_bounds> chunk_bounds(threads);
+		parallel_chunks(count, threads, [&](const unsigned t, const size_t begin, const size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const float c[3] = {prim_bounds[i].centroid(0), prim_bounds[i].centroid(1), prim_bounds[i].centroid(2)};
+				chunk_bounds[t].grow(c);
+			}
+		});
+		bvh_bounds centroid_bounds;
+		for (const auto& b : chunk_bounds)
+			centroid_bounds.grow(b);
+
+		float scale[3];
+		for (int a = 0; a < 3; a++)
+		{
+			const float extent = centroid_bounds.max[a] - centroid_bounds.min[a];
+			scale[a] = extent > 0 ? 1023.99f / extent : 0.0f;
+		}
+
+		// Spreads the low 10 bits of v so two zero bits follow each one.
+		auto spread = [](uint32_t v)
+		{
+			v = (v | (v << 16)) & 0x030000ffu;
+			v = (v | (v << 8)) & 0x0300f00fu;
+			v = (v | (v << 4)) & 0x030c30c3u;
+			v = (v | (v << 2)) & 0x09249249u;
+			return v;
+		};
+
+		// The code goes in the high half of each key and the primitive in the low half.
+		std::vector<uint64_t> keys(count);
+		parallel_chunks(count, threads, [&](unsigned, const size_t begin, const size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t code = 0;
+				for (int a = 0; a < 3; a++)
+				{
+					const auto cell = static_cast<uint32_t>((prim_bounds[i].centroid(a) - centroid_bounds.min[a]) * scale[a]);
+					code |= spread(std::min(cell, 1023u)) << (2 - a);
+				}
+				keys[i] = static_cast<uint64_t>(code) << 32 | i;
+			}
+		});
+
+		radix_sort(keys, threads);
+
+		std::vector<uint32_t> codes(count);
+		parallel_chunks(count, threads, [&](unsigned, const size_t begin, const size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				codes[i] = static_cast<uint32_t>(keys[i] >> 32);
+				indices[i] = static_cast<uint32_t>(keys[i]);
+			}
+		});
+		return codes;
+	}
+
+	// Stable least-significant-digit radix sort of keys by their 30-bit codes, 10 bits per
+	// pass. Each thread counts and scatters its own chunk.
+	static void radix_sort(std::vector<uint64_t>& keys, const unsigned threads)
+	{
+		constexpr int digit_bits = 10;
+		constexpr size_t buckets = size_t(1) << digit_bits;
+		std::vector<uint64_t> sorted(keys.size());
+		std::vector<size_t> offsets(threads * buckets);
+		for (int shift = 32; shift < 62; shift += digit_bits)
+		{
+			auto digit = [shift](const uint64_t key) { return static_cast<size_t>(key >> shift) & (buckets - 1); };
+
+			std::fill(offsets.begin(), offsets.end(), 0);
+			parallel_chunks(keys.size(), threads, [&](const unsigned t, const size_t begin, const size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					offsets[t * buckets + digit(keys[i])]++;
+			});
+
+			// Thread t's keys with digit d go after every smaller digit and after the keys with
+			// digit d of earlier threads, which keeps the sort stable.
+			size_t sum = 0;
+			for (size_t d = 0; d < buckets; d++)
+			{
+				for (unsigned t = 0; t < threads; t++)
+				{
+					const size_t n = offsets[t * buckets + d];
+					offsets[t * buckets + d] = sum;
+					sum += n;
+				}
+			}
+
+			parallel_chunks(keys.size(), threads, [&](const unsigned t, const size_t begin, const size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					sorted[offsets[t * buckets + digit(keys[i])]++] = keys[i];
+			});
+			keys.swap(sorted);
+		}
+	}
+
+	// Splits a Morton-sorted range where the highest bit in which its codes differ turns on.
+	// Ranges of equal codes, and ranges deep enough to risk the stack limit, split evenly.
+	static uint32_t morton_split(const std::vector<uint32_t>& codes, const uint32_t begin, const uint32_t end,
+	                             const int depth)
+	{
+		uint32_t differing = codes[begin] ^ codes[end - 1];
+		if (differing == 0 || depth >= max_sah_depth)
+			return begin + (end - begin) / 2;
+
+		uint32_t bit = 1;
+		while (differing >>= 1)
+			bit <<= 1;
+		return static_cast<uint32_t>(
+			std::partition_point(codes.begin() + begin, codes.begin() + end,
+			                     [bit](const uint32_t code) { return (code & bit) == 0; })
+			- codes.begin());
+	}
+
+	// Calls work(t, begin, end) for `threads` equal chunks of [0, count), each on its own thread.
+	template <typename Work>
+	static void parallel_chunks(const size_t count, const unsigned threads, Work&& work)
+	{
+		if (threads == 1)
+		{
+			work(0u, size_t(0), count);
+			return;
+		}
+		std::vector<std::thread> pool;
+		for (unsigned t = 0; t < threads; t++)
+			pool.emplace_back([&, t] { work(t, count * t / threads, count * (t + 1) / threads); });
+		for (auto& thread : pool)
+			thread.join();
+	}
+
+	unsigned worker_count() const
+	{
+		return thread_count > 0 ? thread_count : std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Fits node `index` to its primitives, or to its children, which must already be fitted.
+	template <typename Bounds>
+	void fit_node(const uint32_t index, Bounds& bounds_of)
+	{
+		bvh_node& node = nodes[index];
+		bvh_bounds start, end;
+		if (node.is_leaf())
+		{
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+			{
+				bvh_bounds s, e;
+				bounds_of(i, s, e);
+				start.grow(s);
+				end.grow(e);
+			}
+		}
+		else
+		{
+			start = nodes[index + 1].bounds;
+			start.grow(nodes[node.offset].bounds);
+			if (!end_bounds.empty())
+			{
+				end = end_bounds[index + 1];
+				end.grow(end_bounds[node.offset]);
+			}
+		}
+
+		if (end_bounds.empty())
+		{
+			start.grow(end);
+			node.bounds = start;
+		}
+		else
+		{
+			node.bounds = start;
+			end_bounds[index] = end;
+		}
+	}
+
+	unsigned refit_threads() const
+	{
+		return nodes.size() < parallel_refit_nodes ? 1u : worker_count();
+	}
+
+	// One past the last node of the subtree rooted at `index`: its rightmost leaf comes last.
+	uint32_t subtree_end(uint32_t index) const
+	{
+		while (!nodes[index].is_leaf())
+			index = nodes[index].offset;
+		return index + 1;
+	}
+
+	// Surface area of a node, averaged over both ends of the motion.
+	double node_area(const uint32_t index) const
+	{
+		if (end_bounds.empty())
+			return nodes[index].bounds.surface_area();
+		return 0.5 * (nodes[index].bounds.surface_area() + end_bounds[index].surface_area());
+	}
+
+	// Interior nodes cost one visit, leaves one test per primitive, weighted by their area.
+	double node_cost(const uint32_t index) const
+	{
+		return node_area(index) * (nodes[index].is_leaf() ? nodes[index].count : 1);
+	}
+
+	template <bool Motion>
+	double enter(const uint32_t index, const ray& r, const interval& ray_t) const
+	{
+		const bvh_bounds& b = nodes[index].bounds;
+		if (!Motion)
+			return ray_box_entry(r, b.min, b.max, ray_t);
+
+		const bvh_bounds& e = end_bounds[index];
+		const double time = r.time();
+		double lo[3], hi[3];
+		for (int a = 0; a < 3; a++)
+		{
+			lo[a] = b.min[a] + time * (e.min[a] - b.min[a]);
+			hi[a] = b.max[a] + time * (e.max[a] - b.max[a]);
+		}
+		return ray_box_entry(r, lo, hi, ray_t);
+	}
+
+	template <bool AnyHit, bool Motion, typename Intersect>
+	bool traverse(const ray& r, interval ray_t, Intersect& intersect) const
+	{
+		if (nodes.empty())
+			return false;
+
+		if (enter<Motion>(0, r, ray_t) == infinity)
+			return false;
+
+		struct stack_entry
+		{
+			uint32_t node;
+			double t_enter;
+		};
+		stack_entry stack[stack_size];
+		int stack_top = 0;
+		uint32_t current = 0;
+		bool hit_anything = false;
+
+		while (true)
+		{
+			const bvh_node& node = nodes[current];
+			if (node.is_leaf())
+			{
+				for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+				{
+					if (intersect(i, ray_t))
+					{
+						if (AnyHit)
+							return true;
+						hit_anything = true;
+					}
+				}
+			}
+			else
+			{
+				uint32_t near_child = current + 1;
+				uint32_t far_child = node.offset;
+				double t_near = enter<Motion>(near_child, r, ray_t);
+				double t_far = enter<Motion>(far_child, r, ray_t);
+				if (t_far < t_near)
+				{
+					std::swap(near_child, far_child);
+					std::swap(t_near, t_far);
+				}
+
+				if (t_near != infinity)
+				{
+					if (t_far != infinity)
+						stack[stack_top++] = {far_child, t_far};
+					current = near_child;
+					continue;
+				}
+			}
+
+			// Pop the next subtree that still starts before the closest hit so far.
+			do
+			{
+				if (stack_top == 0)
+					return hit_anything;
+				--stack_top;
+			}
+			while (stack[stack_top].t_enter > ray_t.max);
+			current = stack[stack_top].node;
+		}
+	}
+};
+
+#endif
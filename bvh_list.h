@@ -0,0 +1,227 @@
+#ifndef BVH_LIST_H
+#define BVH_LIST_H
+
+#include "hittable_list.h"
+#include "bvh.h"
+
+#include <vector>
+
+// A hittable_list with a BVH over its objects. Together with instance (whose objects may be
+// meshes with their own BVH, or other bvh_lists) this forms a two-level hierarchy: the top
+// level only bounds instances, and each unique object keeps its own bottom-level tree.
+// Unbounded objects such as planes can't go in the tree and are tested separately.
+//
+// For animation, objects can be changed in place between frames (moved, resized, given a new
+// transform) and reported to update(), which refits the tree instead of rebuilding it.
+class bvh_list : public hittable
+{
+public:
+	explicit bvh_list(const hittable_list& list, const bvh_builder builder = bvh_builder::sah)
+		: slot_of(list.objects.size(), no_slot), builder(builder)
+	{
+		for (size_t i = 0; i < list.objects.size(); i++)
+		{
+			const auto& object = list.objects[i];
+			const aabb box = object->bounding_box();
+			if (box.is_empty())
+				continue;
+			if (is_unbounded(box))
+			{
+				unbounded.push_back(object);
+				continue;
+			}
+			objects.push_back(object);
+			list_index_of.push_back(static_cast<uint32_t>(i));
+		}
+		rebuild();
+	}
+
+	// Refits the tree to objects that changed in place, given by their positions in the list
+	// the bvh_list was built from. Bounded objects must stay bounded. The cost grows with the
+	// number of changes, not the size of the scene, until the tree has degraded too far from a
+	// fresh build, when it's rebuilt. Not safe while rays are being traced.
+	void update(const std::vector<size_t>& changed)
+	{
+		std::vector<uint32_t> slots;
+		slots.reserve(changed.size());
+		for (const size_t index : changed)
+		{
+			if (slot_of[index] != no_slot)
+				slots.push_back(slot_of[index]);
+		}
+
+		tree.refit(slots, [&](const uint32_t i, bvh_bounds& start, bvh_bounds& end)
+		{
+			aabb s, e;
+			objects[i]->motion_bounds(s, e);
+			start = bvh_bounds::from(s);
+			end = bvh_bounds::from(e);
+		});
+
+		if (tree.needs_rebuild())
+		{
+			rebuild();
+			rebuilds++;
+		}
+		else
+			update_bounds();
+	}
+
+	// Builds the tree again from the objects' current bounds.
+	void rebuild()
+	{
+		std::vector<bvh_bounds> start_bounds, end_bounds;
+		start_bounds.reserve(objects.size());
+		end_bounds.reserve(objects.size());
+		bool any_motion = false;
+		for (const auto& object : objects)
+		{
+			aabb start, end;
+			object->motion_bounds(start, end);
+			start_bounds.push_back(bvh_bounds::from(start));
+			end_bounds.push_back(bvh_bounds::from(end));
+			any_motion |= !same_box(start, end);
+		}
+
+		if (any_motion)
+			tree.build_motion(start_bounds, end_bounds, 1, builder);
+		else
+			tree.build(start_bounds, 1, builder);
+
+		// Keep objects in leaf order, so leaves index them directly.
+		std::vector<shared_ptr<hittable>> ordered(objects.size());
+		std::vector<uint32_t> ordered_index(objects.size());
+		for (uint32_t slot = 0; slot < objects.size(); slot++)
+		{
+			ordered[slot] = std::move(objects[tree.indices[slot]]);
+			ordered_index[slot] = list_index_of[tree.indices[slot]];
+			slot_of[ordered_index[slot]] = slot;
+		}
+		objects.swap(ordered);
+		list_index_of.swap(ordered_index);
+		tree.indices.clear();
+		tree.indices.shrink_to_fit();
+
+		update_bounds();
+	}
+
+	// Times update() gave up on refitting and rebuilt the tree.
+	int rebuild_count() const { return rebuilds; }
+
+	double sah_cost() const { return tree.sah_cost(); }
+
+	void account(memory_report& report) const override
+	{
+		report.add("scene: lists", sizeof(*this) + vector_bytes(objects) + vector_bytes(unbounded)
+		           + vector_bytes(slot_of) + vector_bytes(list_index_of));
+		report.add("acceleration: bvh", tree.memory_bytes());
+		for (const auto& object : objects)
+			report.add_shared(object.get());
+		for (const auto& object : unbounded)
+			report.add_shared(object.get());
+	}
+
+	void compact() override
+	{
+		for (const auto& object : objects)
+			object->compact();
+		for (const auto& object : unbounded)
+			object->compact();
+	}
+
+	bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+	{
+		bool hit_anything = false;
+
+		for (const auto& object : unbounded)
+		{
+			if (object->hit(r, ray_t, rec))
+			{
+				hit_anything = true;
+				ray_t.max = rec.t;
+			}
+		}
+
+		// Objects only write rec when they report a hit, and each hit narrows the interval, so
+		// rec always ends up holding the closest one.
+		hit_anything |= tree.closest_hit(r, ray_t, [&](const uint32_t i, interval& t)
+		{
+			if (!objects[i]->hit(r, t, rec))
+				return false;
+			t.max = rec.t;
+			return true;
+		});
+
+		return hit_anything;
+	}
+
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		for (const auto& object : unbounded)
+		{
+			if (object->occluded(r, ray_t))
+				return true;
+		}
+
+		return tree.any_hit(r, ray_t, [&](const uint32_t i, const interval& t)
+		{
+			return objects[i]->occluded(r, t);
+		});
+	}
+
+	aabb bounding_box() const override { return bbox; }
+
+	void motion_bounds(aabb& start, aabb& end) const override
+	{
+		start = start_box;
+		end = end_box;
+	}
+
+private:
+	static constexpr uint32_t no_slot = ~0u;
+
+	std::vector<shared_ptr<hittable>> objects; // Bounded objects, in BVH leaf order
+	std::vector<shared_ptr<hittable>> unbounded;
+	std::vector<uint32_t> slot_of; // Leaf slot of each list position, no_slot if not in the tree
+	std::vector<uint32_t> list_index_of; // List position of each leaf slot
+	bvh_tree tree;
+	bvh_builder builder;
+	aabb bbox;
+	aabb start_box, end_box; // At time 0 and time 1
+	int rebuilds = 0;
+
+	void update_bounds()
+	{
+		tree.motion_bounds(start_box, end_box);
+		for (const auto& object : unbounded)
+		{
+			aabb start, end;
+			object->motion_bounds(start, end);
+			start_box = aabb(start_box, start);
+			end_box = aabb(end_box, end);
+		}
+		bbox = aabb(start_box, end_box);
+	}
+
+	static bool same_box(const aabb& a, const aabb& b)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (a.axis_interval(axis).min != b.axis_interval(axis).min || a.axis_interval(axis).max != b.axis_interval(axis).max)
+				return false;
+		}
+		return true;
+	}
+
+	static bool is_unbounded(const aabb& box)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			if (std::isinf(box.axis_interval(a).min) || std::isinf(box.axis_interval(a).max))
+				return true;
+		}
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef BVH_WIDE_H
+#define BVH_WIDE_H
+
+#include "bvh.h"
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_WIDE_SSE
+#include <emmintrin.h>
+#endif
+
+// A node with up to Width children, 128 bytes for four and 256 for eight. Child bounds are
+// stored axis by axis (structure of arrays), so one SSE instruction covers four children.
+// Children with count > 0 are leaves: `child` is their first primitive position. Otherwise
+// `child` is the index of a node; unused slots hold empty bounds, which no ray enters.
+template <int Width>
+struct alignas(32) bvh_wide_node
+{
+	float lo[3][Width];
+	float hi[3][Width];
+	uint32_t child[Width];
+	uint32_t count[Width];
+};
+
+// A BVH4 or BVH8 collapsed from a built bvh_tree, traversed testing all children of a node at
+// once. Leaves keep the binary tree's primitive positions, so the intersect callbacks are the
+// same as for bvh_tree. Trees over moving primitives can't be collapsed.
+//
+// Boxes are tested in single precision. To stay conservative, the ray origin is rounded away
+// from each slab and exit distances are scaled up as in Ize, "Robust BVH Ray Traversal" (2013),
+// so rounding can only add boxes to a ray's path, never drop one from it.
+template <int Width>
+class bvh_wide
+{
+	static_assert(Width == 4 || Width == 8, "Wide BVH nodes have four or eight children");
+
+public:
+	std::vector<bvh_wide_node<Width>> nodes;
+
+	bvh_wide() = default;
+
+	explicit bvh_wide(const bvh_tree& tree) { collapse(tree); }
+
+	void collapse(const bvh_tree& tree)
+	{
+		nodes.clear();
+		if (tree.empty() || !tree.end_bounds.empty())
+			return;
+
+		if (tree.nodes[0].is_leaf())
+		{
+			// A single leaf still needs a node above it.
+			nodes.emplace_back();
+			clear_node(0);
+			set_child(0, 0, tree.nodes[0], 0);
+			return;
+		}
+		collapse_node(tree, 0);
+	}
+
+	bool empty() const { return nodes.empty(); }
+
+	size_t memory_bytes() const { return vector_bytes(nodes); }
+
+	template <typename Intersect>
+	bool closest_hit(const ray& r, const interval ray_t, Intersect&& intersect) const
+	{
+		return traverse<false>(r, ray_t, intersect);
+	}
+
+	template <typename Intersect>
+	bool any_hit(const ray& r, const interval ray_t, Intersect&& intersect) const
+	{
+		return traverse<true>(r, ray_t, intersect);
+	}
+
+private:
+	// The binary tree is at most 64 levels deep, and each wide level pushes at most Width - 1
+	// children beyond the one it descends into.
+	static constexpr int stack_size = 64 * (Width - 1) + 1;
+
+	// Bounds on the relative rounding error of a float slab distance: entries are scaled down
+	// and exits up by 2^-21, more than the 2 gamma(3) the analysis asks for.
+	static constexpr float round_in = 1.0f - 1.0f / (1 << 21);
+	static constexpr float round_out = 1.0f + 1.0f / (1 << 21);
+
+	void clear_node(const uint32_t index)
+	{
+		bvh_wide_node<Width>& node = nodes[index];
+		for (int a = 0; a < 3; a++)
+		{
+			for (int c = 0; c < Width; c++)
+			{
+				node.lo[a][c] = +std::numeric_limits<float>::infinity();
+				node.hi[a][c] = -std::numeric_limits<float>::infinity();
+			}
+		}
+		for (int c = 0; c < Width; c++)
+		{
+			node.child[c] = 0;
+			node.count[c] = 0;
+		}
+	}
+
+	void set_child(const uint32_t index, const int slot, const bvh_node& source, const uint32_t child)
+	{
+		bvh_wide_node<Width>& node = nodes[index];
+		for (int a = 0; a < 3; a++)
+		{
+			node.lo[a][slot] = source.bounds.min[a];
+			node.hi[a][slot] = source.bounds.max[a];
+		}
+		node.child[slot] = source.is_leaf() ? source.offset : child;
+		node.count[slot] = source.count;
+	}
+
+	// Gathers up to Width descendants of binary node `index`, always opening the largest interior
+	// one, then lays out the wide node and recurses into its interior children, depth first.
+	uint32_t collapse_node(const bvh_tree& tree, const uint32_t index)
+	{
+		uint32_t children[Width] = {index + 1, tree.nodes[index].offset};
+		int child_count = 2;
+		while (child_count < Width)
+		{
+			int largest = -1;
+			float largest_area = -1;
+			for (int c = 0; c < child_count; c++)
+			{
+				const bvh_node& node = tree.nodes[children[c]];
+				if (!node.is_leaf() && node.bounds.surface_area() > largest_area)
+				{
+					largest = c;
+					largest_area = node.bounds.surface_area();
+				}
+			}
+			if (largest < 0)
+				break;
+
+			const uint32_t opened = children[largest];
+			children[largest] = opened + 1;
+			children[child_count++] = tree.nodes[opened].offset;
+		}
+
+		const auto wide_index = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+		clear_node(wide_index);
+		for (int c = 0; c < child_count; c++)
+		{
+			const bvh_node& node = tree.nodes[children[c]];
+			const uint32_t child = node.is_leaf() ? 0 : collapse_node(tree, children[c]);
+			set_child(wide_index, c, node, child);
+		}
+		return wide_index;
+	}
+
+	// Per-ray constants of the slab test, one float per axis.
+	struct wide_ray
+	{
+		int sign[3];
+		float inv_dir[3];
+		float origin_near[3]; // Origin rounded to underestimate entry distances
+		float origin_far[3]; // ... and to overestimate exit distances
+
+		explicit wide_ray(const ray& r)
+		{
+			for (int a = 0; a < 3; a++)
+			{
+				sign[a] = r.direction_sign(a);
+				inv_dir[a] = static_cast<float>(r.inverse_direction()[a]);
+				const auto o = static_cast<float>(r.origin()[a]);
+				const float error = std::fabs(o) * (1.0f / (1 << 23));
+				origin_near[a] = sign[a] ? o - error : o + error;
+				origin_far[a] = sign[a] ? o + error : o - error;
+			}
+		}
+	};
+
+	// Tests the ray against every child of `node`. Returns a bit per child the ray enters within
+	// [t_min, t_max] and writes the entry distances to `t_enter`.
+	static int enter(const bvh_wide_node<Width>& node, const wide_ray& wr, const float t_min, const float t_max,
+	                 float t_enter[Width])
+	{
+		int mask = 0;
+#ifdef BVH_WIDE_SSE
+		for (int g = 0; g < Width; g += 4)
+		{
+			__m128 t0 = _mm_set1_ps(t_min);
+			__m128 t1 = _mm_set1_ps(t_max);
+			for (int a = 0; a < 3; a++)
+			{
+				const __m128 near_plane = _mm_load_ps(wr.sign[a] ? &node.hi[a][g] : &node.lo[a][g]);
+				const __m128 far_plane = _mm_load_ps(wr.sign[a] ? &node.lo[a][g] : &node.hi[a][g]);
+				const __m128 inv = _mm_set1_ps(wr.inv_dir[a]);
+				const __m128 t_near = _mm_mul_ps(_mm_sub_ps(near_plane, _mm_set1_ps(wr.origin_near[a])), inv);
+				const __m128 t_far = _mm_mul_ps(_mm_sub_ps(far_plane, _mm_set1_ps(wr.origin_far[a])), inv);
+
+				// With NaN in the first operand (a 0 * inf slab) these return the second one.
+				t0 = _mm_max_ps(t_near, t0);
+				t1 = _mm_min_ps(t_far, t1);
+			}
+			t0 = _mm_mul_ps(t0, _mm_set1_ps(round_in));
+			t1 = _mm_mul_ps(t1, _mm_set1_ps(round_out));
+			_mm_storeu_ps(t_enter + g, t0);
+			mask |= _mm_movemask_ps(_mm_cmple_ps(t0, t1)) << g;
+		}
+#else
+		for (int c = 0; c < Width; c++)
+		{
+			float t0 = t_min;
+			float t1 = t_max;
+			for (int a = 0; a < 3; a++)
+			{
+				const float near_plane = wr.sign[a] ? node.hi[a][c] : node.lo[a][c];
+				const float far_plane = wr.sign[a] ? node.lo[a][c] : node.hi[a][c];
+				const float t_near = (near_plane - wr.origin_near[a]) * wr.inv_dir[a];
+				const float t_far = (far_plane - wr.origin_far[a]) * wr.inv_dir[a];
+				t0 = t_near > t0 ? t_near : t0;
+				t1 = t_far < t1 ? t_far : t1;
+			}
+			t0 *= round_in;
+			t1 *= round_out;
+			t_enter[c] = t0;
+			mask |= (t0 <= t1) << c;
+		}
+#endif
+		return mask;
+	}
+
+	template <bool AnyHit, typename Intersect>
+	bool traverse(const ray& r, interval ray_t, Intersect& intersect) const
+	{
+		if (nodes.empty())
+			return false;
+
+		const wide_ray wr(r);
+		struct stack_entry
+		{
+			uint32_t child;
+			uint32_t count;
+			float t_enter;
+		};
+		stack_entry stack[stack_size];
+		int stack_top = 0;
+		stack[stack_top++] = {0, 0, static_cast<float>(ray_t.min)};
+		bool hit_anything = false;
+
+		while (stack_top > 0)
+		{
+			const stack_entry entry = stack[--stack_top];
+			if (entry.t_enter > ray_t.max)
+				continue;
+
+			if (entry.count > 0)
+			{
+				for (uint32_t i = entry.child; i < entry.child + entry.count; i++)
+				{
+					if (intersect(i, ray_t))
+					{
+						if (AnyHit)
+							return true;
+						hit_anything = true;
+					}
+				}
+				continue;
+			}
+
+			const bvh_wide_node<Width>& node = nodes[entry.child];
+			float t_enter[Width];
+			// The scaling in enter() also covers rounding the interval to float.
+			int mask = enter(node, wr, static_cast<float>(ray_t.min), static_cast<float>(ray_t.max), t_enter);
+
+			// Push the children entered, farthest first, so the nearest is visited next.
+			const int first = stack_top;
+			for (int c = 0; mask != 0; c++, mask >>= 1)
+			{
+				if (!(mask & 1))
+					continue;
+				int i = stack_top++;
+				while (i > first && stack[i - 1].t_enter < t_enter[c])
+				{
+					stack[i] = stack[i - 1];
+					i--;
+				}
+				stack[i] = {node.child[c], node.count[c], t_enter[c]};
+			}
+		}
+		return hit_anything;
+	}
+};
+
+#endif
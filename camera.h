@@ -3,6 +3,8 @@
 
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <map>
 
 #ifndef CAMERA_H
 #define CAMERA_H
@@ -10,9 +12,87 @@
 #include "utilities.h"
 #include "hittable.h"
 #include "material.h"
+#include "environment.h"
+#include "arena.h"
+#include "film.h"
+#include "tile_order.h"
+#include "numa.h"
+#include "metrics.h"
 
 using namespace std;
 
+// A rectangle of pixels [x0, x1) x [y0, y1) and the range of sample indices to take in it.
+struct image_tile
+{
+	int x0, y0, x1, y1;
+	int sample_begin, sample_end;
+
+	int width() const { return x1 - x0; }
+	int height() const { return y1 - y0; }
+};
+
+// Adds rendered tiles to a film in sample order. With several sample passes, the passes of one
+// tile can finish out of order on different threads or workers; one that arrives early waits
+// here until the passes before it are in. Every pixel then sums its passes in the same order
+// whatever the scheduling, and its sample count always means samples [0, count) are in.
+// Not thread-safe: call under the film lock.
+class tile_merger
+{
+public:
+	explicit tile_merger(film& f) : f(f)
+	{
+	}
+
+	void add(const image_tile& tile, const float* tile_sums)
+	{
+		// Tiles are merged whole, so the first pixel's count stands for the tile.
+		const size_t first_pixel = static_cast<size_t>(tile.y0) * f.width + tile.x0;
+		const uint32_t merged = f.sample_counts[first_pixel];
+		if (static_cast<uint32_t>(tile.sample_begin) < merged)
+			return; // Already in, from a reissued copy of the tile
+		if (static_cast<uint32_t>(tile.sample_begin) > merged)
+		{
+			const size_t float_count = 3 * static_cast<size_t>(tile.width()) * tile.height();
+			waiting[{first_pixel, tile.sample_begin}] = {tile, std::vector<float>(tile_sums, tile_sums + float_count)};
+			return;
+		}
+
+		merge(tile, tile_sums);
+		int next_sample = tile.sample_end;
+		for (auto next = waiting.find({first_pixel, next_sample}); next != waiting.end();
+		     next = waiting.find({first_pixel, next_sample}))
+		{
+			merge(next->second.tile, next->second.sums.data());
+			next_sample = next->second.tile.sample_end;
+			waiting.erase(next);
+		}
+	}
+
+private:
+	struct waiting_pass
+	{
+		image_tile tile;
+		std::vector<float> sums;
+	};
+
+	film& f;
+	std::map<std::pair<size_t, int>, waiting_pass> waiting; // By first pixel and first sample
+
+	void merge(const image_tile& tile, const float* tile_sums)
+	{
+		for (int j = tile.y0; j < tile.y1; j++)
+		{
+			const size_t first = static_cast<size_t>(j) * f.width + tile.x0;
+			float* row = f.sums.data() + 3 * first;
+			const float* source = tile_sums + 3 * (j - tile.y0) * tile.width();
+			for (int k = 0; k < 3 * tile.width(); k++)
+				row[k] += source[k];
+			for (int i = 0; i < tile.width(); i++)
+				f.sample_counts[first + i] += tile.sample_end - tile.sample_begin;
+		}
+	}
+};
+
 class camera
 {
 public:
@@ -20,6 +100,21 @@ public:
 	int image_width = 100; // Rendered image width in pixel count
 	int samples_per_pixel = 10; // Count of random samples for each pixel
 	int max_depth = 10; // Maximum number of ray bounces into scene
+	shared_ptr<environment_map> environment; // Light from all directions; the gradient sky if null
+
+	// Quality/speed knobs for long paths. Paths whose throughput falls below roulette_threshold
+	// survive each further bounce with probability throughput / roulette_threshold, so raising
+	// it cuts rays per pixel at the price of more noise, without bias; 0 follows every path to
+	// max_depth. max_sample_value clamps each sample's radiance against fireflies (biased, so
+	// off by default).
+	double roulette_threshold = 0.1;
+	double max_sample_value = 0;
+	sampler_type sampling = sampler_type::sobol; // Sample pattern for pixel, lens and bounce dimensions
+	unsigned int seed = 0; // Seed of the sample patterns
+	int num_threads = 0; // Render threads, 0 for half the hardware threads
+
+	// Every sample value is a function of (seed, pixel, sample index, dimension) only, so for
+	// given settings the image is bitwise identical whatever the thread count or scheduling.
 
 	double vfov = 90; // Vertical view angle (field of view)
 	vec3 lookfrom = vec3(0, 0, 0); // Point camera is looking from
@@ -29,73 +124,202 @@ public:
 	double defocus_angle = 0; // Variation angle of rays through each pixel
 	double focus_dist = 10; // Distance from camera lookfrom point to plane of perfect focus
 
-	void render(const hittable& world)
+	// Rays are sent at times spread evenly over [shutter_open, shutter_close], within the frame
+	// interval [0, 1] over which moving objects move. Equal times switch motion blur off.
+	double shutter_open = 0;
+	double shutter_close = 1;
+
+	int tile_size = 32; // Edge length of the square tiles the image is rendered in
+	tile_order order = tile_order::hilbert; // Order of the tiles, and of the pixels in each tile
+	int sample_passes = 1; // Rounds the samples are split into, each covering the whole image
+	std::string checkpoint_path; // File progress is saved to, none if empty
+	int checkpoint_interval = 60; // Seconds between checkpoints
+	std::string preview_path; // PNG rewritten with the image so far while rendering, none if empty
+	int preview_interval = 500; // Milliseconds between preview updates
+	film preview_backdrop; // Shown in previews where the film has no samples yet, if the same size
+	bool pin_threads = false; // Pin render threads to CPUs, spread over the NUMA nodes
+	std::string status_path; // JSON status file rewritten every second while rendering, none if empty
+	int metrics_port = 0; // Localhost port serving Prometheus metrics while rendering, 0 for none
+
+	// Optional scene copy per NUMA node (see build_node_replicas), read by the threads pinned to
+	// that node instead of the scene passed to render. Setting it implies pin_threads.
+	std::vector<shared_ptr<hittable>> node_scenes;
+
+	// Renders the image and writes it to image.png. Passing the film of an interrupted render
+	// (see load_checkpoint) continues it instead of starting over.
+	void render(const hittable& world, film progress = film())
 	{
 		// Used for measuring rendering time
 		time_t start, end;
 		time(&start);
 		ios_base::sync_with_stdio(false);
 
-		initialize();
+		const film result = render_film(world, std::move(progress));
 
-		// Create a buffer to hold the image data
-		std::vector<unsigned char> image_data(image_width * image_height * 3);
+		time(&end);
+		const double time_taken = static_cast<double>(end - start);
 
-		// Mutex for synchronizing access to the image buffer
-		std::mutex image_mutex;
+		std::clog << "\r\033[KRender done in " << fixed << setprecision(2) << time_taken << "s\n" << std::flush;
 
-		// Function to render a chunk of the image
-		std::mutex log_mutex;
-		std::atomic<int> scanlines_processed(0);
+		write_image(result, "image.png");
+	}
+
+	// Renders the image into a buffer of 8-bit RGB triples, row by row from the top.
+	std::vector<unsigned char> render_image(const hittable& world)
+	{
+		return resolve(render_film(world));
+	}
 
-		auto render_chunk = [&](const int start_row, const int end_row)
+	// Renders every tile the film doesn't hold yet and returns the completed film.
+	film render_film(const hittable& world, film progress = film())
+	{
+		std::vector<film> films;
+		films.push_back(std::move(progress));
+		return std::move(render_views({this}, world, std::move(films))[0]);
+	}
+
+	// Renders several views of one scene as a single job, e.g. a stereo pair or a set of product
+	// angles. The views share one set of threads and their tiles are interleaved, so all views
+	// finish at about the same time and no thread idles while another view still has work.
+	// Each view keeps its own image settings, sampler and checkpoint file; the job-wide settings
+	// (threads, pinning, scene replicas, metrics) come from the first view. `progress` may hold
+	// a film per view to continue from. Returns a film per view.
+	//
+	// Setting `*cancel` stops the job within a pixel: tiles in flight are dropped and the films
+	// come back with whatever was merged before.
+	static std::vector<film> render_views(const std::vector<camera*>& views, const hittable& world,
+	                                      std::vector<film> progress = {},
+	                                      const std::atomic<bool>* cancel = nullptr)
+	{
+		const camera& job = *views.front();
+		progress.resize(views.size());
+
+		struct work_item
 		{
-			for (int j = start_row; j < end_row; j++)
+			size_t view;
+			image_tile tile;
+		};
+
+		std::vector<std::vector<image_tile>> view_tiles(views.size());
+		std::vector<std::vector<std::unique_ptr<film_snapshotter>>> writers;
+		int largest_tile = 1;
+		for (size_t v = 0; v < views.size(); v++)
+		{
+			camera& view = *views[v];
+			view.initialize();
+			if (progress[v].empty())
+				progress[v] = film(view.image_width, view.image_height);
+
+			for (const image_tile& tile : view.make_work())
 			{
-				for (int i = 0; i < image_width; i++)
-				{
-					color pixel_color(0, 0, 0);
-					for (int sample = 0; sample < samples_per_pixel; sample++)
-					{
-						ray r = get_ray(i, j);
-						pixel_color += ray_color(r, max_depth, world);
-					}
+				if (!view.tile_done(progress[v], tile))
+					view_tiles[v].push_back(tile);
+			}
 
-					// Calculate the index in the buffer for this pixel
-					const int index = 3 * (j * image_width + i);
+			writers.push_back(view.make_film_writers());
+			largest_tile = std::max(largest_tile, view.tile_size);
+		}
 
-					// Write the color to the buffer
-					std::lock_guard<std::mutex> lock(image_mutex);
-					write_color(image_data.data(), index, pixel_samples_scale * pixel_color);
+		// Round-robin over the views.
+		std::vector<work_item> work;
+		for (size_t i = 0, added = 1; added > 0; i++)
+		{
+			added = 0;
+			for (size_t v = 0; v < views.size(); v++)
+			{
+				if (i < view_tiles[v].size())
+				{
+					work.push_back({v, view_tiles[v][i]});
+					added++;
 				}
+			}
+		}
+
+		// Threads pull tiles off a shared counter, so no thread idles while another still has a
+		// band of expensive rows left. Merging is brief, but a checkpoint or preview snapshot must
+		// not see a tile half-merged, so it happens under the film lock.
+		std::atomic<size_t> next_item(0);
+		std::mutex film_mutex;
+		std::vector<tile_merger> mergers;
+		for (film& f : progress)
+			mergers.emplace_back(f);
+
+		// Determine the number of threads to use
+		int thread_count = job.render_thread_count();
+		thread_count = (thread_count > static_cast<int>(work.size())) ? static_cast<int>(work.size()) : thread_count;
+		std::clog << work.size() << " tiles to render\n";
+
+		uint64_t total_samples = 0;
+		for (const work_item& item : work)
+		{
+			const image_tile& tile = item.tile;
+			total_samples += static_cast<uint64_t>(tile.width()) * tile.height() * (tile.sample_end - tile.sample_begin);
+		}
+		render_metrics metrics(thread_count, work.size(), total_samples);
+		metrics_reporter reporter(metrics, job.status_path, job.metrics_port);
 
-				// Update the atomic counter
-				++scanlines_processed;
+		const bool pinned = job.pin_threads || !job.node_scenes.empty();
+		const numa_topology topology = pinned ? numa_topology::detect() : numa_topology();
 
-				// Calculate and display the percentage of completion
-				if (j % 10 == 0)
+		auto render_worker = [&](const int thread_index)
+		{
+			// Pin before touching any per-thread memory, so the tile buffer in the scratch arena
+			// is first touched, and so placed, on this thread's node.
+			const hittable* scene = &world;
+			if (pinned)
+			{
+				const thread_placement place = topology.place_thread(thread_index);
+				pin_current_thread(place.cpu);
+				if (place.node < static_cast<int>(job.node_scenes.size()) && job.node_scenes[place.node])
+					scene = job.node_scenes[place.node].get();
+			}
+
+			std::vector<std::unique_ptr<sampler>> samplers(views.size());
+			arena& scratch = scratch_arena();
+			float* tile_sums = static_cast<float*>(scratch.allocate(sizeof(float) * 3 * largest_tile * largest_tile,
+			                                                        alignof(float)));
+
+			thread_counters& counters = metrics.thread(thread_index);
+			for (size_t t = next_item++; t < work.size() && !(cancel && *cancel); t = next_item++)
+			{
+				const auto tile_start = std::chrono::steady_clock::now();
+				counters.working.store(true, std::memory_order_relaxed);
+
+				const size_t v = work[t].view;
+				const image_tile& tile = work[t].tile;
+				const camera& view = *views[v];
+				if (!samplers[v])
+					samplers[v] = view.make_pixel_sampler();
+
+				const uint64_t rays = view.render_tile(*scene, tile, *samplers[v], tile_sums, cancel);
+				if (cancel && *cancel)
+				{
+					counters.working.store(false, std::memory_order_relaxed);
+					break;
+				}
 				{
-					std::lock_guard<std::mutex> lock(log_mutex);
-					const double percentage = (100.0 * scanlines_processed) / image_height;
-					std::clog << "\rProgress: " << std::fixed << std::setprecision(2) << percentage << "% complete" <<
-						std::flush;
+					std::lock_guard<std::mutex> lock(film_mutex);
+					mergers[v].add(tile, tile_sums);
 				}
+				for (const auto& writer : writers[v])
+					writer->update(progress[v], film_mutex);
+
+				counters.working.store(false, std::memory_order_relaxed);
+				counters.add(counters.rays, rays);
+				counters.add(counters.samples,
+				             static_cast<uint64_t>(tile.width()) * tile.height() * (tile.sample_end - tile.sample_begin));
+				counters.add(counters.tiles, 1);
+				counters.add(counters.busy_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(
+					             std::chrono::steady_clock::now() - tile_start).count());
 			}
-		};
 
-		// Determine the number of threads to use
-		int num_threads = 0.5 * std::thread::hardware_concurrency();
-		num_threads = (num_threads < 1) ? 1 : num_threads;
-		const int chunk_size = image_height / num_threads;
+			scratch.reset();
+		};
 
 		// Create and launch threads
 		std::vector<std::thread> threads;
-		for (int t = 0; t < num_threads; t++)
-		{
-			int start_row = t * chunk_size;
-			int end_row = (t == num_threads - 1) ? image_height : start_row + chunk_size;
-			threads.emplace_back(render_chunk, start_row, end_row);
-		}
+		for (int t = 0; t < thread_count; t++)
+			threads.emplace_back(render_worker, t);
 
 		// Join threads
 		for (auto& thread : threads)
@@ -103,39 +327,22 @@ public:
 			thread.join();
 		}
 
-		time(&end);
-		const double time_taken = static_cast<double>(end - start);
-
-		std::clog << "\r\033[KRender done in " << fixed << time_taken << setprecision(2) << "s\n" << std::flush;
-
-		if (stbi_write_png("image.png", image_width, image_height, 3, image_data.data(), image_width * 3))
-		{
-			clog << "\nImage written to image.png\n";
-		}
-		else
+		reporter.stop();
+		for (size_t v = 0; v < views.size(); v++)
 		{
-			cerr << "\nFailed to write image to file.\n";
+			for (const auto& writer : writers[v])
+				writer->update(progress[v], film_mutex, true);
 		}
+		return progress;
 	}
 
-private:
-	int image_height = 200; // Rendered image height
-	double pixel_samples_scale = 0.1; // Color scale factor for a sum of pixel samples
-	vec3 center; // Camera center
-	vec3 pixel00_loc; // Location of pixel 0, 0
-	vec3 pixel_delta_u; // Offset to pixel to the right
-	vec3 pixel_delta_v; // Offset to pixel below
-	vec3 u, v, w; // Camera frame basis vectors
-	vec3 defocus_disk_u; // Defocus disk horizontal radius
-	vec3 defocus_disk_v; // Defocus disk vertical radius
-
+	// Derives the image height and the view geometry from the settings above. The render entry
+	// points call it; code driving render_tile directly must call it first.
 	void initialize()
 	{
 		image_height = static_cast<int>(image_width / aspect_ratio);
 		image_height = (image_height < 1) ? 1 : image_height;
 
-		pixel_samples_scale = 1.0 / samples_per_pixel;
-
 		center = lookfrom;
 
 		// Determine viewport dimensions.
@@ -165,59 +372,387 @@ private:
 		const auto defocus_radius = focus_dist * tan(degrees_to_radians(defocus_angle / 2));
 		defocus_disk_u = u * defocus_radius;
 		defocus_disk_v = v * defocus_radius;
+
+		pixel_spread = pixel_delta_v.length() / focus_dist;
+
+		pixel_order = grid_order(order, tile_size, tile_size);
+	}
+
+	int get_image_height() const { return image_height; }
+
+	int render_thread_count() const
+	{
+		const int count = num_threads > 0 ? num_threads : static_cast<int>(0.5 * std::thread::hardware_concurrency());
+		return (count < 1) ? 1 : count;
+	}
+
+	// Memory a render with these settings holds at its peak; call initialize() first.
+	void account(memory_report& report) const
+	{
+		const auto pixels = static_cast<size_t>(image_width) * image_height;
+		report.add("framebuffer: film", pixels * (3 * sizeof(float) + sizeof(uint32_t)));
+		report.add("framebuffer: 8-bit image", 3 * pixels);
+		if (!preview_backdrop.empty())
+		{
+			report.add("framebuffer: preview backdrop",
+			           vector_bytes(preview_backdrop.sums) + vector_bytes(preview_backdrop.sample_counts));
+		}
+		// Each thread's tile sums live in its scratch arena, which allocates at least 64 KiB.
+		const size_t tile_bytes = sizeof(float) * 3 * tile_size * tile_size;
+		report.add("framebuffer: tile buffers", render_thread_count() * std::max<size_t>(tile_bytes, 64 << 10),
+		           render_thread_count());
+		if (environment)
+			report.add_shared(environment.get());
 	}
 
-	ray get_ray(const int i, const int j) const
+	// Splits the image into tiles that each take samples [sample_begin, sample_end).
+	std::vector<image_tile> make_tiles(const int sample_begin, const int sample_end) const
+	{
+		std::vector<image_tile> tiles;
+		const int columns = (image_width + tile_size - 1) / tile_size;
+		const int rows = (image_height + tile_size - 1) / tile_size;
+		for (const grid_point& p : grid_order(order, columns, rows))
+		{
+			const int x = p.x * tile_size;
+			const int y = p.y * tile_size;
+			tiles.push_back({x, y, std::min(x + tile_size, image_width), std::min(y + tile_size, image_height),
+			                 sample_begin, sample_end});
+		}
+		return tiles;
+	}
+
+	// All tiles of all sample passes, in the order they should be rendered.
+	std::vector<image_tile> make_work() const
+	{
+		std::vector<image_tile> work;
+		const int passes = std::max(1, std::min(sample_passes, samples_per_pixel));
+		for (int pass = 0; pass < passes; pass++)
+		{
+			const std::vector<image_tile> tiles = make_tiles(samples_per_pixel * pass / passes,
+			                                                 samples_per_pixel * (pass + 1) / passes);
+			work.insert(work.end(), tiles.begin(), tiles.end());
+		}
+		return work;
+	}
+
+	// Tiles are merged whole, so the first pixel's count stands for the tile, and tile_merger
+	// merges passes in order, so a count of n means samples [0, n) are in.
+	bool tile_done(const film& f, const image_tile& tile) const
+	{
+		return f.sample_counts[static_cast<size_t>(tile.y0) * image_width + tile.x0]
+			>= static_cast<uint32_t>(tile.sample_end);
+	}
+
+	// Settings that change pixel values; films and tiles are only interchangeable between
+	// renders that agree on them.
+	std::vector<uint32_t> settings_fingerprint() const
+	{
+		return {
+			static_cast<uint32_t>(image_width), static_cast<uint32_t>(image_height),
+			static_cast<uint32_t>(samples_per_pixel), seed, static_cast<uint32_t>(max_depth),
+			static_cast<uint32_t>(sampling), float_bits(static_cast<float>(roulette_threshold)),
+			float_bits(static_cast<float>(max_sample_value)), environment ? environment->fingerprint() : 0u,
+			float_bits(static_cast<float>(shutter_open)), float_bits(static_cast<float>(shutter_close))
+		};
+	}
+
+	// A checkpoint also depends on how the work was cut up.
+	std::vector<uint32_t> checkpoint_fingerprint() const
+	{
+		std::vector<uint32_t> fingerprint = settings_fingerprint();
+		fingerprint.push_back(static_cast<uint32_t>(tile_size));
+		fingerprint.push_back(static_cast<uint32_t>(sample_passes));
+		return fingerprint;
+	}
+
+	// Writers that save this view's film while it renders: the checkpoint file and the preview
+	// image, whichever are enabled.
+	std::vector<std::unique_ptr<film_snapshotter>> make_film_writers() const
+	{
+		std::vector<std::unique_ptr<film_snapshotter>> writers;
+		if (!checkpoint_path.empty())
+		{
+			writers.push_back(std::make_unique<film_snapshotter>(
+				std::chrono::seconds(checkpoint_interval),
+				[path = checkpoint_path, fingerprint = checkpoint_fingerprint()](const film& f)
+				{
+					save_checkpoint(path, f, fingerprint);
+				}));
+		}
+		if (!preview_path.empty())
+		{
+			writers.push_back(std::make_unique<film_snapshotter>(
+				std::chrono::milliseconds(preview_interval),
+				[this](const film& f)
+				{
+					if (preview_backdrop.width != f.width || preview_backdrop.height != f.height)
+					{
+						write_png(f, preview_path);
+						return;
+					}
+					film shown = f;
+					for (size_t pixel = 0; pixel < shown.sample_counts.size(); pixel++)
+					{
+						if (shown.sample_counts[pixel] > 0)
+							continue;
+						shown.sample_counts[pixel] = preview_backdrop.sample_counts[pixel];
+						for (int k = 0; k < 3; k++)
+							shown.sums[3 * pixel + k] = preview_backdrop.sums[3 * pixel + k];
+					}
+					write_png(shown, preview_path);
+				}));
+		}
+		return writers;
+	}
+
+	std::unique_ptr<sampler> make_pixel_sampler() const
+	{
+		return make_sampler(sampling, samples_per_pixel, seed);
+	}
+
+	// Writes the radiance sums of the tile's samples to `tile_sums`, which holds one RGB triple
+	// per tile pixel in row-major order. Returns the number of rays traced. If `*cancel` gets
+	// set the tile is abandoned half-done.
+	uint64_t render_tile(const hittable& world, const image_tile& tile, sampler& s, float* tile_sums,
+	                     const std::atomic<bool>* cancel = nullptr) const
+	{
+		uint64_t rays = 0;
+		for (const grid_point& p : pixel_order)
+		{
+			if (cancel && cancel->load(std::memory_order_relaxed))
+				break;
+
+			// Edge tiles are cut off by the image border.
+			if (p.x >= tile.width() || p.y >= tile.height())
+				continue;
+
+			const int i = tile.x0 + p.x;
+			const int j = tile.y0 + p.y;
+			color pixel_color(0, 0, 0);
+			for (int sample = tile.sample_begin; sample < tile.sample_end; sample++)
+			{
+				s.start_pixel_sample(i, j, sample);
+				ray r = get_ray(i, j, s);
+				pixel_color += clamp_sample(ray_color(r, world, s, rays));
+			}
+
+			float* out = tile_sums + 3 * (p.y * tile.width() + p.x);
+			out[0] = static_cast<float>(pixel_color.x());
+			out[1] = static_cast<float>(pixel_color.y());
+			out[2] = static_cast<float>(pixel_color.z());
+		}
+		return rays;
+	}
+
+	// Converts the film to 8-bit RGB, averaging each pixel over the samples it has so far.
+	std::vector<unsigned char> resolve(const film& f) const
+	{
+		std::vector<unsigned char> image_data(f.sums.size());
+		for (size_t pixel = 0; pixel < f.sample_counts.size(); pixel++)
+		{
+			const size_t index = 3 * pixel;
+			const double scale = f.sample_counts[pixel] > 0 ? 1.0 / f.sample_counts[pixel] : 0.0;
+			const color pixel_color(f.sums[index], f.sums[index + 1], f.sums[index + 2]);
+			write_color(image_data.data(), static_cast<int>(index), scale * pixel_color);
+		}
+		return image_data;
+	}
+
+	// Writes the film as a PNG. The image goes to a temporary file first and is renamed into
+	// place, so viewers watching the file never load a half-written image.
+	bool write_png(const film& f, const std::string& path) const
+	{
+		const std::vector<unsigned char> image_data = resolve(f);
+		const std::string temporary = path + ".tmp";
+		if (!stbi_write_png(temporary.c_str(), f.width, f.height, 3, image_data.data(), f.width * 3))
+			return false;
+		std::remove(path.c_str());
+		return std::rename(temporary.c_str(), path.c_str()) == 0;
+	}
+
+	bool write_image(const film& f, const char* path) const
+	{
+		if (write_png(f, path))
+		{
+			clog << "\nImage written to " << path << "\n";
+			return true;
+		}
+		cerr << "\nFailed to write image to file.\n";
+		return false;
+	}
+
+private:
+	int image_height = 200; // Rendered image height
+	vec3 center; // Camera center
+	vec3 pixel00_loc; // Location of pixel 0, 0
+	vec3 pixel_delta_u; // Offset to pixel to the right
+	vec3 pixel_delta_v; // Offset to pixel below
+	vec3 u, v, w; // Camera frame basis vectors
+	vec3 defocus_disk_u; // Defocus disk horizontal radius
+	vec3 defocus_disk_v; // Defocus disk vertical radius
+	double pixel_spread; // Angle a pixel subtends, the spread of a camera ray's cone
+	std::vector<grid_point> pixel_order; // Pixel visiting order within a tile
+
+	// Sampler dimension layout: every path draws the pixel jitter and the lens from fixed
+	// dimensions, then each bounce gets its own block.
+	static constexpr int pixel_dimension = 0;
+	static constexpr int lens_dimension = 2;
+	static constexpr int time_dimension = 4;
+	static constexpr int first_bounce_dimension = 5;
+	static constexpr int dimensions_per_bounce = 5;
+	static constexpr int roulette_offset = 2; // Materials draw at most two values per bounce
+	static constexpr int light_offset = 3; // The environment light sample
+
+	// Each path carries a cone that says how wide a patch of surface it stands for, which
+	// textures use to pick a mip level. Camera rays start with the spread of a pixel; after a
+	// diffuse bounce the cone widens to this rough stand-in for the lobe (radians).
+	static constexpr double diffuse_cone_spread = 0.25;
+
+	ray get_ray(const int i, const int j, sampler& s) const
 	{
 		// Construct a camera ray originating from the defocus disk and directed at a randomly
-		// sampled point around the pixel location i, j.
+		// sampled point around the pixel location i, j, at a sampled time while the shutter is open.
 
-		const auto offset = sample_square();
+		s.set_dimension(pixel_dimension);
+		const auto offset = sample_square(s.get_2d());
 		const auto pixel_sample = pixel00_loc
 			+ ((i + offset.x()) * pixel_delta_u)
 			+ ((j + offset.y()) * pixel_delta_v);
 
-		const auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
+		s.set_dimension(lens_dimension);
+		const auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample(s.get_2d());
 
 		const auto ray_direction = pixel_sample - ray_origin;
 
-		return ray(ray_origin, ray_direction);
+		double ray_time = shutter_open;
+		if (shutter_close != shutter_open)
+		{
+			s.set_dimension(time_dimension);
+			ray_time += s.get_1d() * (shutter_close - shutter_open);
+		}
+
+		return ray(ray_origin, ray_direction, ray_time);
 	}
 
-	static vec3 sample_square()
+	static vec3 sample_square(const sample2& u)
 	{
-		// Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit square.
-		return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+		// Returns the vector to a sampled point in the [-.5,-.5]-[+.5,+.5] unit square.
+		return vec3(u.x - 0.5, u.y - 0.5, 0);
 	}
 
-	vec3 defocus_disk_sample() const
+	vec3 defocus_disk_sample(const sample2& u) const
 	{
-		// Returns a random point in the camera defocus disk.
-		auto p = random_in_unit_disk();
+		// Returns a sampled point in the camera defocus disk.
+		auto p = sample_unit_disk(u.x, u.y);
 		return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
 	}
 
-	static color ray_color(const ray& r, const int depth, const hittable& world)
+	color ray_color(const ray& r, const hittable& world, sampler& s, uint64_t& rays) const
 	{
-		// If we've exceeded the ray bounce limit, no more light is gathered.
-		if (depth <= 0)
-			return color(0, 0, 0);
+		// Follows the path iteratively, carrying its throughput: the product of the attenuations
+		// so far, i.e. how much of whatever light the path finds reaches the camera.
+		ray current = r;
+		color throughput(1, 1, 1);
+		color radiance(0, 0, 0);
+		double scatter_pdf = 0; // Density of the last bounce's direction, 0 for the camera or specular
+		double cone_width = 0;
+		double cone_spread = pixel_spread;
+		for (int bounce = 0; bounce < max_depth; bounce++)
+		{
+			rays++;
+
+			hit_record rec;
+			if (!world.hit(current, interval(0.001, infinity), rec))
+			{
+				if (!environment)
+					return radiance + throughput * sky_color(current);
+
+				// The light sample at the last bounce could have found this direction too; the
+				// power heuristic splits the contribution between the two strategies.
+				double weight = 1;
+				if (scatter_pdf > 0)
+					weight = power_heuristic(scatter_pdf, environment->pdf(current.direction()));
+				return radiance + weight * throughput * environment->radiance(current.direction());
+			}
 
-		hit_record rec;
+			rec.footprint = cone_width + cone_spread * rec.t * current.direction().length();
+
+			const int dimension = first_bounce_dimension + bounce * dimensions_per_bounce;
+			if (environment)
+				radiance += throughput * sample_environment(world, current, rec, s, dimension + light_offset, rays);
 
-		if (world.hit(r, interval(0.001, infinity), rec))
-		{
 			ray scattered;
 			color attenuation;
-			if (rec.mat->scatter(r, rec, attenuation, scattered))
-				return attenuation * ray_color(scattered, depth - 1, world);
-			return vec3(0, 0, 0);
+			s.set_dimension(dimension);
+			if (!rec.mat->scatter(current, rec, attenuation, scattered, s))
+				return radiance;
+			throughput = throughput * attenuation;
+			scatter_pdf = rec.mat->scattering_pdf(current, rec, scattered.direction());
+			cone_width = rec.footprint;
+			if (scatter_pdf > 0)
+				cone_spread = diffuse_cone_spread;
+
+			// Russian roulette: a path that can only contribute little ends at random, and the
+			// survivors are weighted up to keep the estimate unbiased.
+			const double strength = fmax(throughput.x(), fmax(throughput.y(), throughput.z()));
+			if (strength < roulette_threshold)
+			{
+				const double survival = strength / roulette_threshold;
+				s.set_dimension(dimension + roulette_offset);
+				if (s.get_1d() >= survival)
+					return radiance;
+				throughput = throughput / survival;
+			}
+
+			current = scattered;
 		}
 
+		// If we've exceeded the ray bounce limit, no more light is gathered.
+		return radiance;
+	}
+
+	// Next event estimation: light reflected at `rec` from one direction picked by the
+	// environment's importance sampling, if nothing blocks it. Specular materials can't be lit
+	// this way and get their environment light from the scattered ray alone.
+	color sample_environment(const hittable& world, const ray& r_in, const hit_record& rec, sampler& s,
+		const int dimension, uint64_t& rays) const
+	{
+		s.set_dimension(dimension);
+		vec3 direction;
+		double light_pdf;
+		const color light = environment->sample(s.get_2d(), direction, light_pdf);
+		if (light_pdf <= 0)
+			return color(0, 0, 0);
+
+		double material_pdf;
+		const color f = rec.mat->evaluate(r_in, rec, direction, material_pdf);
+		if (material_pdf <= 0)
+			return color(0, 0, 0);
+
+		rays++;
+		if (world.occluded(ray(rec.p, direction, r_in.time()), interval(0.001, infinity)))
+			return color(0, 0, 0);
+		return f * light * (power_heuristic(light_pdf, material_pdf) / light_pdf);
+	}
+
+	static double power_heuristic(const double pdf, const double other_pdf)
+	{
+		return pdf * pdf / (pdf * pdf + other_pdf * other_pdf);
+	}
+
+	static color sky_color(const ray& r)
+	{
 		const vec3 unit_direction = unit_vector(r.direction());
 		const auto a = 0.5 * (unit_direction.y() + 1.0);
 		return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
 	}
+
+	// Scales down a sample brighter than max_sample_value, keeping its hue.
+	color clamp_sample(const color& c) const
+	{
+		const double peak = fmax(c.x(), fmax(c.y(), c.z()));
+		return max_sample_value > 0 && peak > max_sample_value ? c * (max_sample_value / peak) : c;
+	}
 };
 
 #endif
@@ -2,8 +2,9 @@
 #define CUBE_H
 
 #include "hittable.h"
+#include "material_base.h"
 
-class cube : public hittable
+class cube final : public hittable
 {
 public:
 	cube(const vec3& min, const vec3& max, shared_ptr<material> mat)
@@ -11,48 +12,69 @@ public:
 	{
 	}
 
-	bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+	bool hit(const ray& r, const interval ray_t, hit_record& rec) const override
 	{
-		for (int a = 0; a < 3; a++)
+		double t_near[3], t_far[3], t_enter, t_exit;
+		ray_box_slabs(r, min.e, max.e, t_near, t_far, t_enter, t_exit);
+		if (t_enter > t_exit)
+			return false;
+
+		// The surface is hit where the ray enters the box, or where it leaves it when the ray
+		// starts inside (as refracted rays do). The normal follows from the slab crossed there:
+		// the entering face of an axis faces against the ray, the exiting face along it.
+		auto normal = vec3(0, 0, 0);
+		if (ray_t.surrounds(t_enter))
 		{
-			const auto invD = 1.0f / r.direction()[a];
-			auto t0 = (min[a] - r.origin()[a]) * invD;
-			auto t1 = (max[a] - r.origin()[a]) * invD;
-			if (invD < 0.0f) std::swap(t0, t1);
-			ray_t.min = t0 > ray_t.min ? t0 : ray_t.min;
-			ray_t.max = t1 < ray_t.max ? t1 : ray_t.max;
-			if (ray_t.max <= ray_t.min) return false;
+			rec.t = t_enter;
+			const int axis = slab_axis(t_near, t_enter);
+			normal[axis] = r.direction_sign(axis) ? 1 : -1;
 		}
-		rec.t = ray_t.min;
-		rec.p = r.at(rec.t);
-
-		// Compute normal
-		for (int a = 0; a < 3; a++)
+		else if (ray_t.surrounds(t_exit))
 		{
-			if (rec.p[a] == min[a])
-			{
-				auto normal = vec3(0, 0, 0);
-				normal[a] = -1;
-				rec.set_face_normal(r, normal);
-				break;
-			}
-			if (rec.p[a] == max[a])
-			{
-				auto normal = vec3(0, 0, 0);
-				normal[a] = 1;
-				rec.set_face_normal(r, normal);
-				break;
-			}
+			rec.t = t_exit;
+			const int axis = slab_axis(t_far, t_exit);
+			normal[axis] = r.direction_sign(axis) ? -1 : 1;
 		}
+		else
+			return false;
 
-		rec.mat = mat;
+		rec.p = r.at(rec.t);
+		rec.set_face_normal(r, normal);
+		set_face_uv(rec, normal);
+		rec.mat = mat.get();
 		return true;
 	}
 
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		double t_near[3], t_far[3], t_enter, t_exit;
+		ray_box_slabs(r, min.e, max.e, t_near, t_far, t_enter, t_exit);
+		return t_enter <= t_exit && (ray_t.surrounds(t_enter) || ray_t.surrounds(t_exit));
+	}
+
+	aabb bounding_box() const override { return aabb(min, max); }
+
+	void account(memory_report& report) const override
+	{
+		report.add("primitive: cube", sizeof(*this));
+		report.add_shared(mat.get());
+	}
+
 private:
 	vec3 min;
 	vec3 max;
 	shared_ptr<material> mat;
+
+	// Each face is covered once by the unit square of u, v, along the two axes it spans.
+	void set_face_uv(hit_record& rec, const vec3& normal) const
+	{
+		const int axis = normal[0] != 0 ? 0 : normal[1] != 0 ? 1 : 2;
+		const int a = (axis + 1) % 3;
+		const int b = (axis + 2) % 3;
+		rec.u = (rec.p[a] - min[a]) / (max[a] - min[a]);
+		rec.v = (rec.p[b] - min[b]) / (max[b] - min[b]);
+		rec.uv_per_length = 1 / fmin(max[a] - min[a], max[b] - min[b]);
+	}
 };
 
 #endif
@@ -10,7 +10,7 @@ public:
 	{
 	}
 
-	bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+	bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
 	const override
 	{
 		attenuation = color(1.0, 1.0, 1.0);
@@ -23,15 +23,20 @@ public:
 		const bool cannot_refract = ri * sin_theta > 1.0;
 		vec3 direction;
 
-		if (cannot_refract || reflectance(cos_theta, ri) > random_double())
+		if (cannot_refract || reflectance(cos_theta, ri) > s.get_1d())
 			direction = reflect(unit_direction, rec.normal);
 		else
 			direction = refract(unit_direction, rec.normal, ri);
 
-		scattered = ray(rec.p, direction);
+		scattered = ray(rec.p, direction, r_in.time());
 		return true;
 	}
 
+	void account(memory_report& report) const override
+	{
+		report.add("material: dielectric", sizeof(*this));
+	}
+
 private:
 	double refraction_index;
 
@@ -0,0 +1,81 @@
+#ifndef DISK_H
+#define DISK_H
+
+#include "hittable.h"
+#include "material_base.h"
+#include "onb.h"
+
+class disk final : public hittable
+{
+public:
+	// Textures are projected onto the disk once, like a decal.
+	disk(const vec3& center, const vec3& normal, const double radius, shared_ptr<material> mat)
+		: center(center), normal(unit_vector(normal)), radius(fmax(0, radius)), mat(mat), axes(this->normal)
+	{
+		D = dot(this->normal, center);
+
+		// Along each axis the rim reaches radius * sin of the angle between the axis and the normal.
+		vec3 extent;
+		for (int a = 0; a < 3; a++)
+			extent[a] = this->radius * sqrt(fmax(0.0, 1 - this->normal[a] * this->normal[a]));
+		bbox = aabb(center - extent, center + extent);
+	}
+
+	bool hit(const ray& r, const interval ray_t, hit_record& rec) const override
+	{
+		double t;
+		vec3 offset;
+		if (!intersect(r, ray_t, t, offset))
+			return false;
+
+		rec.t = t;
+		rec.p = r.at(t);
+		rec.set_face_normal(r, normal);
+		rec.u = 0.5 + dot(offset, axes.u()) / (2 * radius);
+		rec.v = 0.5 + dot(offset, axes.v()) / (2 * radius);
+		rec.uv_per_length = 1 / (2 * radius);
+		rec.mat = mat.get();
+		return true;
+	}
+
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		double t;
+		vec3 offset;
+		return intersect(r, ray_t, t, offset);
+	}
+
+	aabb bounding_box() const override { return bbox; }
+
+	void account(memory_report& report) const override
+	{
+		report.add("primitive: disk", sizeof(*this));
+		report.add_shared(mat.get());
+	}
+
+private:
+	vec3 center;
+	vec3 normal;
+	double radius;
+	double D; // Plane equation: dot(normal, p) = D
+	shared_ptr<material> mat;
+	onb axes; // In-plane directions of u and v
+	aabb bbox;
+
+	// Hits the plane, then checks the distance from the center.
+	bool intersect(const ray& r, const interval& ray_t, double& t, vec3& offset) const
+	{
+		const auto denom = dot(normal, r.direction());
+		if (fabs(denom) < 1e-8)
+			return false;
+
+		t = (D - dot(normal, r.origin())) / denom;
+		if (!ray_t.surrounds(t))
+			return false;
+
+		offset = r.at(t) - center;
+		return offset.length_squared() <= radius * radius;
+	}
+};
+
+#endif
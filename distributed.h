@@ -0,0 +1,301 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "camera.h"
+#include "net.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+
+// Distributed rendering. A coordinator splits the frame into tiles (and optionally into sample
+// ranges per tile) and hands them to worker processes over TCP; workers send back the radiance
+// sums of each tile, which the coordinator adds into the frame. Workers build the scene from the
+// same command line as the coordinator, and since samples depend only on the seed, pixel and
+// sample index, the merged image matches a single-process render.
+//
+// Workers may connect at any time and may drop out: the tile a lost or silent worker was
+// rendering goes back into the queue for the next free worker.
+//
+// Protocol, all fields 32-bit in network byte order:
+//   worker -> coordinator  hello: magic, version
+//   coordinator -> worker  settings: camera::settings_fingerprint(), tile_size
+//   coordinator -> worker  tile: message_tile, x0, y0, x1, y1, sample_begin, sample_end
+//                          or done: message_done
+//   worker -> coordinator  result: float count, then the tile sums as float bits
+
+namespace distributed_detail
+{
+	constexpr uint32_t magic = 0x52545748; // "RTWH"
+	constexpr uint32_t version = 2;
+	constexpr uint32_t message_tile = 1;
+	constexpr uint32_t message_done = 2;
+	constexpr int hello_timeout = 10; // Seconds a new connection gets to introduce itself
+
+	inline std::string encode_settings(const camera& cam)
+	{
+		std::string message;
+		for (const uint32_t v : cam.settings_fingerprint())
+			put_u32(message, v);
+		// Workers render a tile through a pixel order made for their own tile size.
+		put_u32(message, static_cast<uint32_t>(cam.tile_size));
+		return message;
+	}
+
+	// Tiles waiting to be rendered. Workers take tiles from the front; tiles lost with a worker
+	// are put back at the front so holes in the image are filled first.
+	class tile_queue
+	{
+	public:
+		explicit tile_queue(const std::vector<image_tile>& tiles) : pending(tiles.begin(), tiles.end()),
+		                                                            total(tiles.size())
+		{
+		}
+
+		// Waits until a tile is available. Returns false once every tile is complete.
+		bool acquire(image_tile& tile)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [&] { return !pending.empty() || completed == total; });
+			if (pending.empty())
+				return false;
+			tile = pending.front();
+			pending.pop_front();
+			return true;
+		}
+
+		void reissue(const image_tile& tile)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending.push_front(tile);
+			changed.notify_one();
+		}
+
+		size_t complete()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (++completed == total)
+				changed.notify_all();
+			return completed;
+		}
+
+		bool finished()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return completed == total;
+		}
+
+		size_t size() const { return total; }
+
+	private:
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::deque<image_tile> pending;
+		size_t completed = 0;
+		size_t total;
+	};
+}
+
+// Renders the frame on whatever workers connect to `port` and returns the completed film, or an
+// empty one if the port can't be opened. With camera::sample_passes above 1 every tile is also
+// split into sample ranges, so small frames still spread across many workers. A worker that
+// stays silent for `worker_timeout` seconds on a tile is treated as lost. Like camera::render,
+// the coordinator saves checkpoints and previews and can continue from a loaded film.
+inline film run_coordinator(camera& cam, const uint16_t port, const int worker_timeout = 300,
+                            film progress = film())
+{
+	using namespace distributed_detail;
+
+	cam.initialize();
+
+	if (progress.empty())
+		progress = film(cam.image_width, cam.get_image_height());
+
+	std::vector<image_tile> tiles;
+	for (const image_tile& tile : cam.make_work())
+	{
+		if (!cam.tile_done(progress, tile))
+			tiles.push_back(tile);
+	}
+
+	tcp_socket listener = tcp_socket::listen(port);
+	if (!listener.valid())
+	{
+		std::cerr << "Failed to listen on port " << port << "\n";
+		return {};
+	}
+	std::clog << "Waiting for workers on port " << port << "\n";
+
+	tile_queue queue(tiles);
+	std::mutex film_mutex;
+	tile_merger merger(progress);
+	const std::vector<std::unique_ptr<film_snapshotter>> writers = cam.make_film_writers();
+	const std::string settings = encode_settings(cam);
+
+	auto serve_worker = [&](tcp_socket worker)
+	{
+		char hello[8];
+		worker.set_receive_timeout(hello_timeout);
+		if (!worker.receive_all(hello, sizeof(hello)) || get_u32(hello) != magic || get_u32(hello + 4) != version)
+			return;
+		if (!worker.send_all(settings.data(), settings.size()))
+			return;
+		worker.set_receive_timeout(worker_timeout);
+
+		image_tile tile;
+		std::vector<char> payload;
+		std::vector<float> tile_sums;
+		while (queue.acquire(tile))
+		{
+			std::string message;
+			put_u32(message, message_tile);
+			for (const int v : {tile.x0, tile.y0, tile.x1, tile.y1, tile.sample_begin, tile.sample_end})
+				put_u32(message, v);
+
+			const size_t float_count = 3 * static_cast<size_t>(tile.width()) * tile.height();
+			char count[4];
+			bool received = worker.send_all(message.data(), message.size()) && worker.receive_all(count, sizeof(count))
+				&& get_u32(count) == float_count;
+			if (received)
+			{
+				payload.resize(4 * float_count);
+				received = worker.receive_all(payload.data(), payload.size());
+			}
+
+			if (!received)
+			{
+				std::clog << "\r\033[KLost a worker, tile at (" << tile.x0 << ", " << tile.y0 << ") reissued\n";
+				queue.reissue(tile);
+				return;
+			}
+
+			tile_sums.resize(float_count);
+			for (size_t k = 0; k < float_count; k++)
+				tile_sums[k] = bits_float(get_u32(payload.data() + 4 * k));
+
+			{
+				std::lock_guard<std::mutex> lock(film_mutex);
+				merger.add(tile, tile_sums.data());
+			}
+			for (const auto& writer : writers)
+				writer->update(progress, film_mutex);
+
+			const size_t done = queue.complete();
+			std::clog << "\rProgress: " << std::fixed << std::setprecision(2) << (100.0 * done) / queue.size()
+				<< "% complete" << std::flush;
+		}
+
+		std::string message;
+		put_u32(message, message_done);
+		worker.send_all(message.data(), message.size());
+	};
+
+	// Accept workers until the frame is done; polling lets the loop notice completion.
+	std::vector<std::thread> connections;
+	while (!queue.finished())
+	{
+		if (!listener.wait_readable(250))
+			continue;
+		tcp_socket worker = listener.accept();
+		if (worker.valid())
+			connections.emplace_back(serve_worker, std::move(worker));
+	}
+
+	for (auto& connection : connections)
+		connection.join();
+
+	for (const auto& writer : writers)
+		writer->update(progress, film_mutex, true);
+	return progress;
+}
+
+// Renders tiles for the coordinator at host:port until it reports the frame done. Each of the
+// `connections` links (one per local render thread) looks like a separate worker to the
+// coordinator. Returns false if no link completed its work.
+inline bool run_worker(camera& cam, const hittable& world, const std::string& host, const uint16_t port,
+                       const int connections)
+{
+	using namespace distributed_detail;
+
+	cam.initialize();
+	const std::string expected_settings = encode_settings(cam);
+	std::atomic<int> finished(0);
+
+	auto work = [&]
+	{
+		// The coordinator may not be up yet; keep trying for a while.
+		tcp_socket coordinator;
+		for (int attempt = 0; attempt < 30 && !coordinator.valid(); attempt++)
+		{
+			coordinator = tcp_socket::connect(host, port);
+			if (!coordinator.valid())
+				std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+		if (!coordinator.valid())
+		{
+			std::cerr << "Failed to connect to " << host << ":" << port << "\n";
+			return;
+		}
+
+		std::string hello;
+		put_u32(hello, magic);
+		put_u32(hello, version);
+		std::string settings(expected_settings.size(), '\0');
+		if (!coordinator.send_all(hello.data(), hello.size()) || !coordinator.receive_all(&settings[0], settings.size()))
+			return;
+		if (settings != expected_settings)
+		{
+			std::cerr << "Coordinator render settings differ from this worker's; disconnecting\n";
+			return;
+		}
+
+		const auto pixel_sampler = cam.make_pixel_sampler();
+		std::vector<float> tile_sums;
+		std::string result;
+		while (true)
+		{
+			char header[28];
+			if (!coordinator.receive_all(header, 4))
+				return;
+			if (get_u32(header) == message_done)
+				break;
+			if (get_u32(header) != message_tile || !coordinator.receive_all(header + 4, 24))
+				return;
+
+			const image_tile tile = {
+				static_cast<int>(get_u32(header + 4)), static_cast<int>(get_u32(header + 8)),
+				static_cast<int>(get_u32(header + 12)), static_cast<int>(get_u32(header + 16)),
+				static_cast<int>(get_u32(header + 20)), static_cast<int>(get_u32(header + 24))
+			};
+			if (tile.x0 < 0 || tile.x1 > cam.image_width || tile.x0 >= tile.x1 || tile.y0 < 0
+				|| tile.y1 > cam.get_image_height() || tile.y0 >= tile.y1 || tile.width() > cam.tile_size
+				|| tile.height() > cam.tile_size || tile.sample_begin < 0 || tile.sample_end > cam.samples_per_pixel
+				|| tile.sample_begin >= tile.sample_end)
+			{
+				std::cerr << "Coordinator sent an invalid tile\n";
+				return;
+			}
+
+			tile_sums.assign(3 * static_cast<size_t>(tile.width()) * tile.height(), 0.0f);
+			cam.render_tile(world, tile, *pixel_sampler, tile_sums.data());
+
+			result.clear();
+			put_u32(result, static_cast<uint32_t>(tile_sums.size()));
+			for (const float f : tile_sums)
+				put_u32(result, float_bits(f));
+			if (!coordinator.send_all(result.data(), result.size()))
+				return;
+		}
+		++finished;
+	};
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < connections; t++)
+		threads.emplace_back(work);
+	for (auto& thread : threads)
+		thread.join();
+
+	return finished > 0;
+}
+
+#endif
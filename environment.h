@@ -0,0 +1,168 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include "utilities.h"
+#include "image_io.h"
+#include "sampler.h"
+#include "memory_report.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Piecewise-constant 1D distribution over [0,1) with n equal cells.
+class distribution_1d
+{
+public:
+	std::vector<double> func;
+	std::vector<double> cdf; // n + 1 entries
+	double integral = 0;
+
+	explicit distribution_1d(std::vector<double> values) : func(std::move(values)), cdf(func.size() + 1)
+	{
+		const size_t n = func.size();
+		cdf[0] = 0;
+		for (size_t i = 0; i < n; i++)
+			cdf[i + 1] = cdf[i] + func[i] / n;
+		integral = cdf[n];
+
+		// An all-black distribution falls back to uniform.
+		for (size_t i = 1; i <= n; i++)
+			cdf[i] = integral > 0 ? cdf[i] / integral : static_cast<double>(i) / n;
+	}
+
+	size_t size() const { return func.size(); }
+
+	// Maps u in [0,1) to a point of the distribution; returns its density and cell.
+	double sample(const double u, double& pdf, size_t& cell) const
+	{
+		cell = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin() - 1;
+		cell = std::min(cell, size() - 1);
+
+		const double width = cdf[cell + 1] - cdf[cell];
+		const double offset = width > 0 ? (u - cdf[cell]) / width : 0.5;
+		pdf = integral > 0 ? func[cell] / integral : 1.0;
+		return (cell + offset) / size();
+	}
+};
+
+// Image-based lighting from an equirectangular (latitude-longitude) HDR image: the top row
+// looks up (+y), and longitude runs around the y axis. At load time the image is turned into
+// a 2D sampling table - a marginal distribution over rows and a conditional one per row, both
+// proportional to luminance times the row's solid angle - so light sampling picks bright
+// texels in proportion to what they contribute.
+class environment_map
+{
+public:
+	environment_map(float_image image, const double intensity = 1.0)
+		: image(std::move(image)), intensity(intensity), marginal(std::vector<double>(1, 0.0))
+	{
+		const int width = this->image.width;
+		const int height = this->image.height;
+
+		std::vector<double> row_integrals(height);
+		conditional.reserve(height);
+		for (int y = 0; y < height; y++)
+		{
+			const double sin_theta = sin(pi * (y + 0.5) / height);
+			std::vector<double> row(width);
+			for (int x = 0; x < width; x++)
+			{
+				const float* t = this->image.texel(x, y);
+				row[x] = (0.2126 * t[0] + 0.7152 * t[1] + 0.0722 * t[2]) * sin_theta;
+			}
+			conditional.emplace_back(std::move(row));
+			row_integrals[y] = conditional.back().integral;
+		}
+		marginal = distribution_1d(std::move(row_integrals));
+
+		// FNV-1a over the size and texels, for render settings fingerprints.
+		checksum = 2166136261u;
+		auto mix = [&](const uint32_t v) { checksum = (checksum ^ v) * 16777619u; };
+		mix(static_cast<uint32_t>(width));
+		mix(static_cast<uint32_t>(height));
+		for (const float f : this->image.rgb)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &f, sizeof(bits));
+			mix(bits);
+		}
+	}
+
+	// Identifies the image and intensity, so renders with different lighting don't mix.
+	uint32_t fingerprint() const
+	{
+		const auto scaled = static_cast<float>(intensity);
+		uint32_t bits;
+		std::memcpy(&bits, &scaled, sizeof(bits));
+		return checksum ^ (bits * 0x9e3779b9u);
+	}
+
+	// Radiance arriving from `direction`: one texel fetch, no filtering.
+	color radiance(const vec3& direction) const
+	{
+		double u, v;
+		direction_to_uv(unit_vector(direction), u, v);
+		const float* t = image.texel(column(u), row(v));
+		return intensity * color(t[0], t[1], t[2]);
+	}
+
+	// Picks a direction towards the environment with probability proportional to its
+	// brightness. Returns its radiance and the density in solid angle.
+	color sample(const sample2& u, vec3& direction, double& pdf) const
+	{
+		double pdf_v, pdf_u;
+		size_t y, x;
+		const double v = marginal.sample(u.x, pdf_v, y);
+		const double uu = conditional[y].sample(u.y, pdf_u, x);
+
+		const double theta = v * pi;
+		const double phi = uu * 2 * pi - pi;
+		const double sin_theta = sin(theta);
+		direction = vec3(sin_theta * cos(phi), cos(theta), sin_theta * sin(phi));
+
+		pdf = sin_theta > 0 ? pdf_v * pdf_u / (2 * pi * pi * sin_theta) : 0.0;
+		const float* t = image.texel(static_cast<int>(x), static_cast<int>(y));
+		return intensity * color(t[0], t[1], t[2]);
+	}
+
+	// Density, in solid angle, with which sample() picks `direction`.
+	double pdf(const vec3& direction) const
+	{
+		double u, v;
+		const vec3 d = unit_vector(direction);
+		direction_to_uv(d, u, v);
+		const double sin_theta = sqrt(fmax(0.0, 1 - d.y() * d.y()));
+		if (sin_theta <= 0 || marginal.integral <= 0)
+			return 0.0;
+		const int y = row(v);
+		return conditional[y].func[column(u)] / marginal.integral / (2 * pi * pi * sin_theta);
+	}
+
+	void account(memory_report& report) const
+	{
+		size_t distributions = vector_bytes(conditional) + vector_bytes(marginal.func) + vector_bytes(marginal.cdf);
+		for (const distribution_1d& d : conditional)
+			distributions += vector_bytes(d.func) + vector_bytes(d.cdf);
+		report.add("texture: environment", sizeof(*this) + vector_bytes(image.rgb) + distributions);
+	}
+
+private:
+	float_image image;
+	double intensity;
+	uint32_t checksum = 0;
+	std::vector<distribution_1d> conditional; // One per row
+	distribution_1d marginal; // Over rows
+
+	static void direction_to_uv(const vec3& d, double& u, double& v)
+	{
+		u = (atan2(d.z(), d.x()) + pi) / (2 * pi);
+		v = acos(fmax(-1.0, fmin(1.0, d.y()))) / pi;
+	}
+
+	int column(const double u) const { return std::min(image.width - 1, static_cast<int>(u * image.width)); }
+	int row(const double v) const { return std::min(image.height - 1, static_cast<int>(v * image.height)); }
+};
+
+#endif
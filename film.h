@@ -0,0 +1,161 @@
+#ifndef FILM_H
+#define FILM_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Radiance accumulated so far: per-pixel sums of sample radiance and the number of samples
+// each sum holds, row by row from the top.
+struct film
+{
+	int width = 0;
+	int height = 0;
+	std::vector<float> sums; // RGB triples
+	std::vector<uint32_t> sample_counts;
+
+	film() = default;
+
+	film(const int width, const int height)
+		: width(width), height(height), sums(3 * static_cast<size_t>(width) * height, 0.0f),
+		  sample_counts(static_cast<size_t>(width) * height, 0)
+	{
+	}
+
+	bool empty() const { return sample_counts.empty(); }
+};
+
+// Checkpoint files hold a film plus a fingerprint of the render settings it was made with, so a
+// resumed render can't silently mix in samples from different settings. The sampler has no
+// state beyond the seed in the fingerprint, so nothing else is needed to continue. Data is in
+// native byte order: checkpoints are meant to be resumed on the same kind of machine.
+
+namespace film_detail
+{
+	constexpr uint32_t checkpoint_magic = 0x4b435452; // "RTCK"
+	// Version 1 films could hold the passes of a tile merged out of order, which a sample count
+	// can't describe; they aren't resumed.
+	constexpr uint32_t checkpoint_version = 2;
+}
+
+inline bool save_checkpoint(const std::string& path, const film& f, const std::vector<uint32_t>& fingerprint)
+{
+	using namespace film_detail;
+
+	// Write to a temporary file first, so a kill mid-write leaves the previous checkpoint intact.
+	const std::string temporary = path + ".tmp";
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		const uint32_t header[] = {
+			checkpoint_magic, checkpoint_version, static_cast<uint32_t>(fingerprint.size()),
+			static_cast<uint32_t>(f.width), static_cast<uint32_t>(f.height)
+		};
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(fingerprint.data()), sizeof(uint32_t) * fingerprint.size());
+		out.write(reinterpret_cast<const char*>(f.sample_counts.data()), sizeof(uint32_t) * f.sample_counts.size());
+		out.write(reinterpret_cast<const char*>(f.sums.data()), sizeof(float) * f.sums.size());
+		if (!out)
+		{
+			std::cerr << "Failed to write checkpoint " << temporary << "\n";
+			return false;
+		}
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		std::cerr << "Failed to replace checkpoint " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+inline bool load_checkpoint(const std::string& path, film& f, const std::vector<uint32_t>& fingerprint)
+{
+	using namespace film_detail;
+
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		std::cerr << "Failed to open checkpoint " << path << "\n";
+		return false;
+	}
+
+	uint32_t header[5];
+	in.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!in || header[0] != checkpoint_magic || header[1] != checkpoint_version)
+	{
+		std::cerr << path << " is not a checkpoint\n";
+		return false;
+	}
+
+	std::vector<uint32_t> saved_fingerprint(header[2]);
+	in.read(reinterpret_cast<char*>(saved_fingerprint.data()), sizeof(uint32_t) * saved_fingerprint.size());
+	if (!in || saved_fingerprint != fingerprint)
+	{
+		std::cerr << "Checkpoint " << path << " was made with different render settings\n";
+		return false;
+	}
+
+	film loaded(static_cast<int>(header[3]), static_cast<int>(header[4]));
+	in.read(reinterpret_cast<char*>(loaded.sample_counts.data()), sizeof(uint32_t) * loaded.sample_counts.size());
+	in.read(reinterpret_cast<char*>(loaded.sums.data()), sizeof(float) * loaded.sums.size());
+	if (!in)
+	{
+		std::cerr << "Checkpoint " << path << " is truncated\n";
+		return false;
+	}
+
+	f = std::move(loaded);
+	return true;
+}
+
+// Hands snapshots of a film that render threads keep adding to to `publish`, at most once per
+// `interval` (checkpoint files, preview images). Threads call update() after merging their
+// work; one of them takes a snapshot under the film's lock and publishes it while the others
+// carry on.
+class film_snapshotter
+{
+public:
+	template <typename Duration>
+	film_snapshotter(const Duration interval, std::function<void(const film&)> publish)
+		: interval(std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval)),
+		  publish(std::move(publish)), last_publish(std::chrono::steady_clock::now())
+	{
+	}
+
+	void update(const film& f, std::mutex& film_mutex, const bool force = false)
+	{
+		std::unique_lock<std::mutex> lock(publish_mutex, std::defer_lock);
+		if (force)
+			lock.lock();
+		else if (!lock.try_lock())
+			return;
+
+		const auto now = std::chrono::steady_clock::now();
+		if (!force && now - last_publish < interval)
+			return;
+		last_publish = now;
+
+		{
+			std::lock_guard<std::mutex> film_lock(film_mutex);
+			snapshot = f;
+		}
+		publish(snapshot);
+	}
+
+private:
+	std::chrono::steady_clock::duration interval;
+	std::function<void(const film&)> publish;
+	std::chrono::steady_clock::time_point last_publish;
+	std::mutex publish_mutex;
+	film snapshot;
+};
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef HITTABLE_H
 #define HITTABLE_H
 
+#include "aabb.h"
+#include "memory_report.h"
+
 class material;
 
 class hit_record
@@ -8,9 +11,12 @@ class hit_record
 public:
 	vec3 p;
 	vec3 normal;
-	shared_ptr<material> mat;
+	const material* mat; // Owned by the primitive that was hit
 	double t;
 	bool front_face;
+	double u = 0, v = 0; // Surface coordinates of p, for textures
+	double uv_per_length = 0; // How fast u, v change per unit of distance along the surface
+	double footprint = 0; // Width of the patch of surface the ray stands for, set by the camera
 
 	void set_face_normal(const ray& r, const vec3& outward_normal)
 	{
@@ -28,6 +34,32 @@ public:
 	virtual ~hittable() = default;
 
 	virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
+
+	// Returns true if anything intersects the ray within ray_t. Unlike hit(), this may stop at
+	// the first intersection found and never fills a hit_record, so it is the query to use for
+	// visibility (shadow rays, ambient occlusion).
+	virtual bool occluded(const ray& r, interval ray_t) const = 0;
+
+	// World-space bounds of the object. Unbounded objects return aabb::universe.
+	virtual aabb bounding_box() const = 0;
+
+	// Bounds at time 0 and time 1, for objects that move; bounding_box() covers the whole
+	// sweep. Motion is linear, so at any time in between the object lies inside the
+	// interpolation of the two.
+	virtual void motion_bounds(aabb& start, aabb& end) const
+	{
+		start = end = bounding_box();
+	}
+
+	// Adds the memory of this object, and of what it owns, to `report`. Parts held through
+	// shared_ptr go through report.add_shared, so shared ones are counted once.
+	virtual void account(memory_report& report) const = 0;
+
+	// Frees what is only needed to update the object in place, when memory is short. Updates
+	// still work afterwards, but cost as much as building the object again.
+	virtual void compact()
+	{
+	}
 };
 
 #endif
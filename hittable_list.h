@@ -17,11 +17,16 @@ public:
 
 	hittable_list(shared_ptr<hittable> object) { add(object); }
 
-	void clear() { objects.clear(); }
+	void clear()
+	{
+		objects.clear();
+		bbox = aabb::empty;
+	}
 
 	void add(shared_ptr<hittable> object)
 	{
 		objects.push_back(object);
+		bbox = aabb(bbox, object->bounding_box());
 	}
 
 	bool hit(const ray& r, const interval ray_t, hit_record& rec) const override
@@ -42,6 +47,47 @@ public:
 
 		return hit_anything;
 	}
+
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		for (const auto& object : objects)
+		{
+			if (object->occluded(r, ray_t))
+				return true;
+		}
+
+		return false;
+	}
+
+	aabb bounding_box() const override { return bbox; }
+
+	void motion_bounds(aabb& start, aabb& end) const override
+	{
+		start = end = aabb::empty;
+		for (const auto& object : objects)
+		{
+			aabb object_start, object_end;
+			object->motion_bounds(object_start, object_end);
+			start = aabb(start, object_start);
+			end = aabb(end, object_end);
+		}
+	}
+
+	void account(memory_report& report) const override
+	{
+		report.add("scene: lists", sizeof(*this) + vector_bytes(objects));
+		for (const auto& object : objects)
+			report.add_shared(object.get());
+	}
+
+	void compact() override
+	{
+		for (const auto& object : objects)
+			object->compact();
+	}
+
+private:
+	aabb bbox;
 };
 
 #endif
@@ -0,0 +1,211 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// A linear floating-point RGB image, row by row from the top.
+struct float_image
+{
+	int width = 0;
+	int height = 0;
+	std::vector<float> rgb;
+
+	bool empty() const { return rgb.empty(); }
+
+	const float* texel(const int x, const int y) const { return &rgb[3 * (static_cast<size_t>(y) * width + x)]; }
+};
+
+namespace image_io_detail
+{
+	inline void rgbe_to_float(const unsigned char* rgbe, float* rgb)
+	{
+		if (rgbe[3] == 0)
+		{
+			rgb[0] = rgb[1] = rgb[2] = 0.0f;
+			return;
+		}
+		const float scale = std::ldexp(1.0f, rgbe[3] - (128 + 8));
+		rgb[0] = (rgbe[0] + 0.5f) * scale;
+		rgb[1] = (rgbe[1] + 0.5f) * scale;
+		rgb[2] = (rgbe[2] + 0.5f) * scale;
+	}
+
+	// Reads one scanline of RGBE pixels, either flat or in the adaptive run-length encoding.
+	inline bool read_rgbe_scanline(std::istream& in, const int width, std::vector<unsigned char>& scanline)
+	{
+		scanline.resize(4 * static_cast<size_t>(width));
+
+		unsigned char start[4];
+		if (!in.read(reinterpret_cast<char*>(start), 4))
+			return false;
+
+		const bool run_length = width >= 8 && width < 32768 && start[0] == 2 && start[1] == 2 && !(start[2] & 0x80);
+		if (!run_length)
+		{
+			std::memcpy(scanline.data(), start, 4);
+			return static_cast<bool>(in.read(reinterpret_cast<char*>(scanline.data()) + 4, 4 * (width - 1)));
+		}
+
+		if ((start[2] << 8 | start[3]) != width)
+			return false;
+
+		// Each of the four channels is encoded separately, as runs and literal spans.
+		std::vector<unsigned char> channel(width);
+		for (int c = 0; c < 4; c++)
+		{
+			int x = 0;
+			while (x < width)
+			{
+				unsigned char count;
+				if (!in.read(reinterpret_cast<char*>(&count), 1))
+					return false;
+				if (count > 128)
+				{
+					count -= 128;
+					unsigned char value;
+					if (count > width - x || !in.read(reinterpret_cast<char*>(&value), 1))
+						return false;
+					std::memset(&channel[x], value, count);
+				}
+				else
+				{
+					if (count == 0 || count > width - x || !in.read(reinterpret_cast<char*>(&channel[x]), count))
+						return false;
+				}
+				x += count;
+			}
+			for (int i = 0; i < width; i++)
+				scanline[4 * i + c] = channel[i];
+		}
+		return true;
+	}
+}
+
+// Loads a Radiance RGBE (.hdr) image. Only the standard "-Y height +X width" orientation is
+// supported. Returns an empty image and prints the reason on failure.
+inline float_image load_hdr(const std::string& path)
+{
+	using namespace image_io_detail;
+
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		std::cerr << "Failed to open " << path << "\n";
+		return {};
+	}
+
+	std::string line;
+	std::getline(in, line);
+	if (line.rfind("#?", 0) != 0)
+	{
+		std::cerr << path << " is not a Radiance HDR file\n";
+		return {};
+	}
+
+	// Header lines up to an empty line, then the resolution.
+	bool rgbe_format = true;
+	while (std::getline(in, line) && !line.empty())
+	{
+		if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe")
+			rgbe_format = false;
+	}
+
+	float_image image;
+	std::getline(in, line);
+	char y_axis[3], x_axis[3];
+	if (!rgbe_format || std::sscanf(line.c_str(), "%2s %d %2s %d", y_axis, &image.height, x_axis, &image.width) != 4
+		|| std::strcmp(y_axis, "-Y") != 0 || std::strcmp(x_axis, "+X") != 0 || image.width <= 0 || image.height <= 0)
+	{
+		std::cerr << path << ": unsupported HDR format or orientation\n";
+		return {};
+	}
+
+	image.rgb.resize(3 * static_cast<size_t>(image.width) * image.height);
+	std::vector<unsigned char> scanline;
+	for (int y = 0; y < image.height; y++)
+	{
+		if (!read_rgbe_scanline(in, image.width, scanline))
+		{
+			std::cerr << path << ": truncated or corrupt pixel data\n";
+			return {};
+		}
+		for (int x = 0; x < image.width; x++)
+			rgbe_to_float(&scanline[4 * x], &image.rgb[3 * (static_cast<size_t>(y) * image.width + x)]);
+	}
+
+	return image;
+}
+
+// Loads a binary PPM (P6, 8 bits per channel). Its sRGB values are converted to linear.
+inline float_image load_ppm(const std::string& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		std::cerr << "Failed to open " << path << "\n";
+		return {};
+	}
+
+	// Header fields are separated by whitespace and may be interleaved with # comments.
+	auto next_field = [&in](std::string& field)
+	{
+		while (in >> field && field[0] == '#')
+			std::getline(in, field);
+		return static_cast<bool>(in);
+	};
+
+	std::string magic, width, height, max_value;
+	if (!next_field(magic) || magic != "P6" || !next_field(width) || !next_field(height) || !next_field(max_value)
+		|| std::stoi(max_value) != 255)
+	{
+		std::cerr << path << " is not an 8-bit binary PPM file\n";
+		return {};
+	}
+	in.get(); // The single whitespace character before the pixels
+
+	float_image image;
+	image.width = std::stoi(width);
+	image.height = std::stoi(height);
+	std::vector<unsigned char> bytes(3 * static_cast<size_t>(image.width) * image.height);
+	if (image.width <= 0 || image.height <= 0 || !in.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+	{
+		std::cerr << path << ": truncated or corrupt pixel data\n";
+		return {};
+	}
+
+	float to_linear[256];
+	for (int i = 0; i < 256; i++)
+	{
+		const float c = i / 255.0f;
+		to_linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+	image.rgb.resize(bytes.size());
+	for (size_t i = 0; i < bytes.size(); i++)
+		image.rgb[i] = to_linear[bytes[i]];
+	return image;
+}
+
+// Loads an image by its extension: .hdr or .ppm.
+inline float_image load_image(const std::string& path)
+{
+	auto has_extension = [&path](const std::string& extension)
+	{
+		return path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+	};
+	if (has_extension(".hdr"))
+		return load_hdr(path);
+	if (has_extension(".ppm"))
+		return load_ppm(path);
+
+	std::cerr << path << ": unsupported image format, expected .hdr or .ppm\n";
+	return {};
+}
+
+#endif
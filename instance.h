@@ -0,0 +1,73 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "hittable.h"
+#include "affine_transform.h"
+
+// A placed copy of a shared object. The geometry (a primitive, a mesh or a whole bvh_list) is
+// held by reference, so many instances of one object cost a transform and a bounding box each
+// instead of a copy of the geometry.
+class instance : public hittable
+{
+public:
+	instance(shared_ptr<hittable> object, const affine_transform& object_to_world)
+		: object(object), world_to_object(object_to_world.inverse()),
+		  bbox(object_to_world.box(object->bounding_box()))
+	{
+	}
+
+	// Moves the instance, for animation; also refreshes the bounds after the shared object itself
+	// changed. A bvh_list holding the instance must be told through update() before the next frame.
+	void set_transform(const affine_transform& object_to_world)
+	{
+		world_to_object = object_to_world.inverse();
+		bbox = object_to_world.box(object->bounding_box());
+	}
+
+	bool hit(const ray& r, const interval ray_t, hit_record& rec) const override
+	{
+		// The object-space direction is not renormalized, so ray parameters match in both spaces.
+		const ray object_ray(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time());
+		if (!object->hit(object_ray, ray_t, rec))
+			return false;
+
+		// The object set the normal facing against the object-space ray; the inverse transpose
+		// keeps that orientation against the world-space ray.
+		rec.p = r.at(rec.t);
+		rec.normal = unit_vector(world_to_object.transposed_vector(rec.normal));
+		return true;
+	}
+
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		const ray object_ray(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time());
+		return object->occluded(object_ray, ray_t);
+	}
+
+	aabb bounding_box() const override { return bbox; }
+
+	void motion_bounds(aabb& start, aabb& end) const override
+	{
+		// Only needed while building trees, so the forward transform is recomputed here rather
+		// than stored in every instance.
+		const affine_transform object_to_world = world_to_object.inverse();
+		object->motion_bounds(start, end);
+		start = object_to_world.box(start);
+		end = object_to_world.box(end);
+	}
+
+	void account(memory_report& report) const override
+	{
+		report.add("primitive: instance", sizeof(*this));
+		report.add_shared(object.get());
+	}
+
+	void compact() override { object->compact(); }
+
+private:
+	shared_ptr<hittable> object;
+	affine_transform world_to_object;
+	aabb bbox;
+};
+
+#endif
@@ -14,6 +14,13 @@ public:
 	{
 	}
 
+	interval(const interval& a, const interval& b)
+	{
+		// Create the interval tightly enclosing the two input intervals.
+		min = a.min <= b.min ? a.min : b.min;
+		max = a.max >= b.max ? a.max : b.max;
+	}
+
 	double size() const
 	{
 		return max - min;
@@ -36,10 +43,21 @@ public:
 		return x;
 	}
 
+	interval expand(const double delta) const
+	{
+		const auto padding = delta / 2;
+		return interval(min - padding, max + padding);
+	}
+
 	static const interval empty, universe;
 };
 
 const interval interval::empty = interval(+infinity, -infinity);
 const interval interval::universe = interval(-infinity, +infinity);
 
+inline interval operator+(const interval& ival, const double displacement)
+{
+	return interval(ival.min + displacement, ival.max + displacement);
+}
+
 #endif
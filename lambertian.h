@@ -2,6 +2,8 @@
 #define LAMBERTIAN_H
 
 #include "material_base.h"
+#include "onb.h"
+#include "texture.h"
 
 class lambertian : public material
 {
@@ -10,22 +12,44 @@ public:
 	{
 	}
 
-	bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
-	const override
+	lambertian(shared_ptr<texture> tex) : tex(tex)
 	{
-		auto scatter_direction = rec.normal + random_unit_vector();
+	}
 
-		// Catch degenerate scatter direction
-		if (scatter_direction.near_zero())
-			scatter_direction = rec.normal;
+	bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
+	const override
+	{
+		// Cosine-weighted direction around the normal, the Lambertian distribution.
+		const sample2 u = s.get_2d();
+		const vec3 scatter_direction = onb(rec.normal).transform(sample_cosine_direction(u.x, u.y));
 
-		scattered = ray(rec.p, scatter_direction);
-		attenuation = albedo;
+		scattered = ray(rec.p, scatter_direction, r_in.time());
+		attenuation = albedo_at(rec);
 		return true;
 	}
 
+	color evaluate(const ray& r_in, const hit_record& rec, const vec3& direction, double& pdf) const override
+	{
+		pdf = scattering_pdf(r_in, rec, direction);
+		return albedo_at(rec) * pdf;
+	}
+
+	double scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override
+	{
+		return fmax(0.0, dot(rec.normal, unit_vector(direction))) / pi;
+	}
+
+	void account(memory_report& report) const override
+	{
+		report.add("material: lambertian", sizeof(*this));
+		report.add_shared(tex.get());
+	}
+
 private:
 	color albedo;
+	shared_ptr<texture> tex; // Overrides albedo when set
+
+	color albedo_at(const hit_record& rec) const { return tex ? tex->value(rec) : albedo; }
 };
 
 #endif
@@ -9,6 +9,19 @@
 #include "sphere.h"
 #include "cube.h"
 #include "plane.h"
+#include "quad.h"
+#include "disk.h"
+#include "triangle.h"
+#include "moving.h"
+#include "mesh_loader.h"
+#include "instance.h"
+#include "bvh_list.h"
+#include "benchmark.h"
+#include "distributed.h"
+#include "static_scene.h"
+#include "preview.h"
+
+#include <cstring>
 
 // Function to configure and add a sphere to the world based on user input
 void configureScene(hittable_list& world, const bool manual)
@@ -86,17 +99,131 @@ void configureScene(hittable_list& world, const bool manual)
 	}
 }
 
-int main()
+// The ground of the default scene: a bounded quad at y = 0, facing up, rather than an infinite
+// plane, so it has a bounding box like everything else. At 200 units across, only rays within
+// about a degree of the horizon get past its edge.
+quad ground_quad(shared_ptr<material> mat, const double texture_size = 0)
 {
-	hittable_list world;
+	return quad(vec3(-100, 0, -100), vec3(0, 0, 200), vec3(200, 0, 0), mat, texture_size);
+}
 
+// The default scene as a static_scene: the same objects, with every primitive call resolved at
+// compile time.
+auto make_default_static_scene()
+{
 	auto material_ground = make_shared<lambertian>(color(0.1, 0.6, 0.1));
-	world.add(make_shared<plane>(vec3(0, 0, 0), vec3(0, 1, 0), material_ground));
+	auto material_center = make_shared<metal>(color(0.9, 0.9, 0.9), 0.0);
+	auto material_2 = make_shared<lambertian>(color(0.1, 0.2, 0.5));
+
+	return static_scene<quad, cube, sphere, sphere>(
+		ground_quad(material_ground),
+		cube(vec3(-0.5, -0.5, -0.5), vec3(0.5, 0.5, 0.5), material_center),
+		sphere(vec3(0.0, 0.9, 0.0), 0.3, material_2),
+		sphere(vec3(-1.5, 0.4, -2.5), 0.3, material_center));
+}
+
+// Renders the scene at 1, 8 and 64 threads and checks that the images are byte-identical.
+bool verify_deterministic_render(camera cam, const hittable& world)
+{
+	// A smaller image keeps the check quick; determinism doesn't depend on the size.
+	cam.image_width = 160;
+	cam.samples_per_pixel = 16;
+
+	std::vector<unsigned char> reference;
+	for (const int threads : {1, 8, 64})
+	{
+		cam.num_threads = threads;
+		const std::vector<unsigned char> image = cam.render_image(world);
+		if (reference.empty())
+			reference = image;
+
+		if (image != reference)
+		{
+			std::cerr << "\r\033[KImage rendered with " << threads << " threads differs from the 1-thread image\n";
+			return false;
+		}
+		std::clog << "\r\033[K" << threads << " threads: identical\n";
+	}
+	return true;
+}
+
+// Configure the scene based on user input
+constexpr bool manual = false;
+
+// Loads an OBJ or PLY mesh, scaled so its largest side is `size` units and stood on the ground
+// centred at `position`. Prints the load time and memory; returns null after printing the reason
+// if the file can't be loaded.
+shared_ptr<hittable> load_scene_mesh(const std::string& path, const double size, const vec3& position)
+{
+	const auto start = std::chrono::steady_clock::now();
+	const shared_ptr<triangle_mesh> mesh = load_mesh(path, make_shared<lambertian>(color(0.7, 0.7, 0.7)));
+	if (!mesh)
+		return nullptr;
+	const double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	memory_report report;
+	mesh->account(report);
+	std::clog << "Loaded " << mesh->triangle_count() << " triangles, " << mesh->vertex_count() << " vertices from "
+		<< path << " in " << std::fixed << std::setprecision(1) << load_ms << " ms: "
+		<< std::setprecision(2) << report.total() / (1024.0 * 1024.0) << " MiB, "
+		<< static_cast<double>(report.total()) / std::max<size_t>(1, mesh->triangle_count())
+		<< " bytes per triangle with its BVH\n";
+
+	const aabb box = mesh->bounding_box();
+	const double largest = fmax(box.x.size(), fmax(box.y.size(), box.z.size()));
+	const double scale = largest > 0 ? size / largest : 1.0;
+	const vec3 base(0.5 * (box.x.min + box.x.max), box.y.min, 0.5 * (box.z.min + box.z.max));
+	return make_shared<instance>(mesh, affine_transform::translate(position)
+	                             * affine_transform::scale(vec3(scale, scale, scale))
+	                             * affine_transform::translate(-base));
+}
+
+// The ground is plain green unless given a texture, which repeats every `texture_size` units.
+// With `motion`, a falling sphere and a sliding box are added to try motion blur with. `mesh`,
+// if given, is added as is.
+shared_ptr<hittable_list> make_world(shared_ptr<texture> ground_texture = nullptr, const double texture_size = 1,
+                                     const bool motion = false, shared_ptr<hittable> mesh = nullptr)
+{
+	auto world = make_shared<hittable_list>();
+
+	auto material_ground = ground_texture ? make_shared<lambertian>(ground_texture)
+		: make_shared<lambertian>(color(0.1, 0.6, 0.1));
+	world->add(make_shared<quad>(ground_quad(material_ground, texture_size)));
+
+	configureScene(*world, manual);
+
+	if (motion)
+	{
+		auto material_red = make_shared<lambertian>(color(0.7, 0.1, 0.1));
+		world->add(make_shared<sphere>(vec3(1.0, 0.5, -1.2), vec3(1.0, 0.25, -1.2), 0.25, material_red));
+		auto box = make_shared<cube>(vec3(-1.4, 0, 0.6), vec3(-1.0, 0.4, 1.0), material_red);
+		world->add(make_shared<moving>(box, vec3(0, 0, 0.3)));
+	}
+	if (mesh)
+		world->add(mesh);
+	return world;
+}
 
-	// Configure the scene based on user input
-	constexpr bool manual = false;
-	configureScene(world, manual);
+// Whether a command line argument is a value rather than the next option. Options start with
+// "--", so negative numbers are values.
+bool is_value(const char* arg)
+{
+	return std::strncmp(arg, "--", 2) != 0;
+}
 
+// What the render will hold in memory: the scene, its NUMA replicas and the camera's buffers.
+memory_report account_render(const camera& cam, const hittable& scene)
+{
+	memory_report report;
+	scene.account(report);
+	for (const auto& replica : cam.node_scenes)
+		report.add_shared(replica.get());
+	cam.account(report);
+	return report;
+}
+
+int main(int argc, char* argv[])
+{
 	camera cam;
 
 	cam.aspect_ratio = 16.0 / 9.0;
@@ -112,8 +239,279 @@ int main()
 	cam.defocus_angle = 1.0;
 	cam.focus_dist = 5;
 
+	const auto static_world = make_default_static_scene();
+	bool use_static_scene = false;
+	bool numa_replicas = false;
+	double eye_separation = -1; // Stereo pair when set
+
+	bool verify_determinism = false;
+	bool interactive = false;
+	int coordinator_port = 0;
+	std::string coordinator_address;
+	int worker_timeout = 300;
+	std::string resume_path;
+	size_t texture_budget = 256; // MiB
+	size_t memory_budget = 0; // MiB, none when 0
+	bool print_memory_report = false;
+	std::string ground_texture_path;
+	double ground_texture_size = 1;
+	bool motion = false;
+	std::string mesh_path;
+	double mesh_size = 1;
+	vec3 mesh_position(-1.3, 0, 0.3);
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (arg == "--benchmark-arena")
+		{
+			// Optional object count, one million by default.
+			const size_t count = has_value && is_value(argv[i + 1]) ? std::stoul(argv[i + 1]) : 1000000;
+			run_arena_benchmark(count);
+			return 0;
+		}
+		if (arg == "--benchmark-refit")
+		{
+			// Optional sphere count, 100000 by default.
+			const size_t count = has_value && is_value(argv[i + 1]) ? std::stoul(argv[i + 1]) : 100000;
+			run_refit_benchmark(count);
+			return 0;
+		}
+		if (arg == "--benchmark-build")
+		{
+			// Optional sphere count, one million by default.
+			const size_t count = has_value && is_value(argv[i + 1]) ? std::stoul(argv[i + 1]) : 1000000;
+			run_build_benchmark(count);
+			return 0;
+		}
+		if (arg == "--verify-determinism")
+			verify_determinism = true;
+		else if (arg == "--static-scene")
+			use_static_scene = true;
+		else if (arg == "--status-file" && has_value)
+			cam.status_path = argv[++i];
+		else if (arg == "--metrics-port" && has_value)
+			cam.metrics_port = std::stoi(argv[++i]);
+		else if (arg == "--stereo")
+			eye_separation = has_value && is_value(argv[i + 1]) ? std::stod(argv[++i]) : 0.1;
+		else if (arg == "--interactive")
+			interactive = true;
+		else if (arg == "--preview" && has_value)
+			cam.preview_path = argv[++i];
+		else if (arg == "--roulette" && has_value)
+			cam.roulette_threshold = std::stod(argv[++i]);
+		else if (arg == "--environment" && has_value)
+		{
+			// Radiance .hdr in latitude-longitude layout, then an optional intensity scale.
+			float_image image = load_hdr(argv[++i]);
+			if (image.empty())
+				return 1;
+			const double intensity = i + 1 < argc && is_value(argv[i + 1]) ? std::stod(argv[++i]) : 1.0;
+			cam.environment = make_shared<environment_map>(std::move(image), intensity);
+		}
+		else if (arg == "--texture-budget" && has_value)
+			texture_budget = std::stoul(argv[++i]);
+		else if (arg == "--memory-budget" && has_value)
+			memory_budget = std::stoul(argv[++i]);
+		else if (arg == "--memory-report")
+			print_memory_report = true;
+		else if (arg == "--ground-texture" && has_value)
+		{
+			// Image file, then optionally the size of one repeat in world units.
+			ground_texture_path = argv[++i];
+			if (i + 1 < argc && is_value(argv[i + 1]))
+				ground_texture_size = std::stod(argv[++i]);
+		}
+		else if (arg == "--mesh" && has_value)
+		{
+			// OBJ or PLY file, then optionally its size in world units and the x y z to stand it on.
+			mesh_path = argv[++i];
+			if (i + 1 < argc && is_value(argv[i + 1]))
+				mesh_size = std::stod(argv[++i]);
+			if (i + 3 < argc && is_value(argv[i + 1]))
+			{
+				const double x = std::stod(argv[++i]);
+				const double y = std::stod(argv[++i]);
+				mesh_position = vec3(x, y, std::stod(argv[++i]));
+			}
+		}
+		else if (arg == "--motion-blur")
+			motion = true;
+		else if (arg == "--shutter" && i + 2 < argc)
+		{
+			cam.shutter_open = std::stod(argv[++i]);
+			cam.shutter_close = std::stod(argv[++i]);
+		}
+		else if (arg == "--clamp" && has_value)
+			cam.max_sample_value = std::stod(argv[++i]);
+		else if (arg == "--pin-threads")
+			cam.pin_threads = true;
+		else if (arg == "--numa-replicas")
+			numa_replicas = true;
+		else if (arg == "--threads" && has_value)
+			cam.num_threads = std::stoi(argv[++i]);
+		else if (arg == "--seed" && has_value)
+			cam.seed = static_cast<unsigned int>(std::stoul(argv[++i]));
+		else if (arg == "--coordinator" && has_value)
+			coordinator_port = std::stoi(argv[++i]);
+		else if (arg == "--worker" && has_value)
+			coordinator_address = argv[++i];
+		else if (arg == "--sample-passes" && has_value)
+			cam.sample_passes = std::stoi(argv[++i]);
+		else if (arg == "--worker-timeout" && has_value)
+			worker_timeout = std::stoi(argv[++i]);
+		else if (arg == "--checkpoint" && has_value)
+			cam.checkpoint_path = argv[++i];
+		else if (arg == "--checkpoint-interval" && has_value)
+			cam.checkpoint_interval = std::stoi(argv[++i]);
+		else if (arg == "--resume" && has_value)
+			resume_path = argv[++i];
+		else if (arg == "--tile-order" && has_value)
+		{
+			const std::string name = argv[++i];
+			cam.order = name == "scanline" ? tile_order::scanline
+				: name == "morton" ? tile_order::morton
+				: tile_order::hilbert;
+		}
+	}
+
+	// Image textures share one cache, bounded by the texture budget.
+	const auto textures = make_shared<texture_cache>(texture_budget << 20);
+	shared_ptr<texture> ground_texture;
+	if (!ground_texture_path.empty())
+	{
+		const int id = textures->add(ground_texture_path);
+		if (id < 0)
+			return 1;
+		ground_texture = make_shared<image_texture>(textures, id);
+	}
+
+	// The mesh is loaded once; NUMA replicas share it rather than each loading their own copy.
+	shared_ptr<hittable> mesh;
+	if (!mesh_path.empty())
+	{
+		mesh = load_scene_mesh(mesh_path, mesh_size, mesh_position);
+		if (!mesh)
+			return 1;
+	}
+
+	auto build_world = [&] { return make_world(ground_texture, ground_texture_size, motion, mesh); };
+	const shared_ptr<hittable_list> world = build_world();
+
+	const hittable& scene = use_static_scene ? static_cast<const hittable&>(static_world) : *world;
+
+	// Give every NUMA node its own copy of the scene. The manual scene can't be replicated, as
+	// it would be asked for once per node, and the static scene is too small to be worth it.
+	if (numa_replicas && !manual && !use_static_scene)
+	{
+		cam.node_scenes = build_node_replicas(numa_topology::detect(), build_world);
+		std::clog << cam.node_scenes.size() << " scene replicas\n";
+	}
+
+	if (memory_budget > 0 || print_memory_report)
+	{
+		cam.initialize();
+		memory_report report = account_render(cam, scene);
+		const size_t budget = memory_budget << 20;
+		if (memory_budget > 0 && report.total() > budget)
+		{
+			// Over budget: first shrink the texture cache into what the rest leaves, then drop the
+			// data kept only for updating the scene in place.
+			const size_t rest = report.total() - report.total("texture: tile cache");
+			if (report.total("texture: tile cache") > 0 && rest < budget)
+				textures->set_budget(budget - rest);
+			world->compact();
+			for (const auto& replica : cam.node_scenes)
+				replica->compact();
+			report = account_render(cam, scene);
+		}
+
+		if (memory_budget > 0 && report.total() > budget)
+		{
+			report.print(std::cerr);
+			std::cerr << "The render needs " << std::fixed << std::setprecision(2) << report.total() / (1024.0 * 1024.0)
+				<< " MiB, over the memory budget of " << memory_budget << " MiB\n";
+			return 1;
+		}
+		if (print_memory_report)
+		{
+			report.print(std::clog);
+			std::clog << "Process resident: " << std::fixed << std::setprecision(2)
+				<< process_resident_bytes() / (1024.0 * 1024.0) << " MiB\n";
+		}
+	}
+
+	// Continue an interrupted render, saving further progress to the same file.
+	film progress;
+	if (!resume_path.empty())
+	{
+		cam.initialize();
+		if (!load_checkpoint(resume_path, progress, cam.checkpoint_fingerprint()))
+			return 1;
+		if (cam.checkpoint_path.empty())
+			cam.checkpoint_path = resume_path;
+	}
+
+	if (coordinator_port > 0)
+	{
+		// Render on remote workers started with --worker host:port and the same scene options.
+		const film result = run_coordinator(cam, static_cast<uint16_t>(coordinator_port), worker_timeout,
+		                                    std::move(progress));
+		return !result.empty() && cam.write_image(result, "image.png") ? 0 : 1;
+	}
+
+	if (!coordinator_address.empty())
+	{
+		const size_t colon = coordinator_address.rfind(':');
+		if (colon == std::string::npos)
+		{
+			std::cerr << "Expected --worker host:port\n";
+			return 1;
+		}
+		const std::string host = coordinator_address.substr(0, colon);
+		const auto port = static_cast<uint16_t>(std::stoi(coordinator_address.substr(colon + 1)));
+		return run_worker(cam, scene, host, port, cam.render_thread_count()) ? 0 : 1;
+	}
+
+	if (interactive)
+	{
+		run_interactive(cam, scene);
+		return 0;
+	}
+
+	if (eye_separation >= 0)
+	{
+		// Left and right eye, shifted along the camera's horizontal axis, rendered as one job.
+		const vec3 right = unit_vector(cross(cam.lookat - cam.lookfrom, cam.vup));
+		const vec3 offset = 0.5 * eye_separation * right;
+		camera left_eye = cam;
+		camera right_eye = cam;
+		left_eye.lookfrom = cam.lookfrom - offset;
+		left_eye.lookat = cam.lookat - offset;
+		right_eye.lookfrom = cam.lookfrom + offset;
+		right_eye.lookat = cam.lookat + offset;
+		if (!cam.checkpoint_path.empty())
+		{
+			left_eye.checkpoint_path = cam.checkpoint_path + ".left";
+			right_eye.checkpoint_path = cam.checkpoint_path + ".right";
+		}
+
+		const std::vector<film> films = camera::render_views({&left_eye, &right_eye}, scene);
+		const bool written = left_eye.write_image(films[0], "image_left.png")
+			&& right_eye.write_image(films[1], "image_right.png");
+		return written ? 0 : 1;
+	}
+
+	if (verify_determinism)
+		return verify_deterministic_render(cam, scene) ? 0 : 1;
+
 	// Render the scene
-	cam.render(world);
+	cam.render(scene, std::move(progress));
+	if (ground_texture)
+	{
+		std::clog << "Texture cache: " << textures->tiles_loaded() << " tiles loaded, "
+			<< (textures->resident_bytes() >> 20) << " of " << (textures->budget_bytes() >> 20) << " MiB in use\n";
+	}
 
 	return 0;
 }
@@ -2,6 +2,8 @@
 #define MATERIAL_BASE_H
 
 #include "utilities.h"
+#include "sampler.h"
+#include "memory_report.h"
 
 class hit_record;
 
@@ -10,12 +12,32 @@ class material
 public:
 	virtual ~material() = default;
 
+	// Draws the scattered ray from the sample values of `s`, which the caller has positioned on
+	// the dimensions of this bounce.
 	virtual bool scatter(
-		const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+		const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s
 	) const
 	{
 		return false;
 	}
+
+	// For light arriving from `direction`: the BSDF times the cosine at the surface, and the
+	// density with which scatter() would pick that direction. Specular materials, whose
+	// scatter() picks a single direction, keep the default of no response and density 0, which
+	// also tells the integrator not to sample lights for them.
+	virtual color evaluate(const ray& r_in, const hit_record& rec, const vec3& direction, double& pdf) const
+	{
+		pdf = 0;
+		return color(0, 0, 0);
+	}
+
+	// Just the density of evaluate(), without looking up the BSDF.
+	virtual double scattering_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const
+	{
+		return 0;
+	}
+
+	virtual void account(memory_report& report) const = 0;
 };
 
 #endif
@@ -0,0 +1,96 @@
+#ifndef MEMORY_REPORT_H
+#define MEMORY_REPORT_H
+
+#include <cstddef>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Heap bytes make_shared adds next to each object: two reference counts and a vtable pointer,
+// in both libstdc++ and the MSVC library.
+constexpr size_t shared_control_bytes = 16;
+
+template <typename T>
+size_t vector_bytes(const std::vector<T>& v)
+{
+	return v.capacity() * sizeof(T);
+}
+
+// Memory a render needs, by category: "primitive: sphere", "material: lambertian",
+// "acceleration: bvh" and so on. Scenes, cameras and caches add themselves through their
+// account() functions; objects shared through shared_ptr are counted once however many owners
+// reach them. Sizes are what the objects ask the heap for, without allocator overhead.
+class memory_report
+{
+public:
+	struct entry
+	{
+		size_t count = 0;
+		size_t bytes = 0;
+	};
+
+	void add(const std::string& category, const size_t bytes, const size_t count = 1)
+	{
+		entry& e = categories[category];
+		e.count += count;
+		e.bytes += bytes;
+	}
+
+	// Accounts an object held through a shared_ptr the first time it is reached, together with
+	// the control block make_shared allocated with it.
+	template <typename T>
+	void add_shared(const T* object)
+	{
+		if (object == nullptr || !seen.insert(object).second)
+			return;
+		add("shared_ptr control blocks", shared_control_bytes);
+		object->account(*this);
+	}
+
+	size_t total() const
+	{
+		size_t bytes = 0;
+		for (const auto& category : categories)
+			bytes += category.second.bytes;
+		return bytes;
+	}
+
+	// Bytes in the categories whose names start with `prefix`, such as "texture:".
+	size_t total(const std::string& prefix) const
+	{
+		size_t bytes = 0;
+		for (const auto& category : categories)
+		{
+			if (category.first.compare(0, prefix.size(), prefix) == 0)
+				bytes += category.second.bytes;
+		}
+		return bytes;
+	}
+
+	const std::map<std::string, entry>& entries() const { return categories; }
+
+	void print(std::ostream& out) const
+	{
+		auto mib = [](const size_t bytes) { return bytes / (1024.0 * 1024.0); };
+		out << std::left << std::setw(34) << "Memory" << std::right << std::setw(10) << "count" << std::setw(12)
+			<< "MiB" << std::setw(12) << "bytes/each" << "\n";
+		for (const auto& category : categories)
+		{
+			const entry& e = category.second;
+			out << std::left << std::setw(34) << category.first << std::right << std::setw(10) << e.count
+				<< std::fixed << std::setprecision(2) << std::setw(12) << mib(e.bytes) << std::setprecision(1)
+				<< std::setw(12) << (e.count > 0 ? static_cast<double>(e.bytes) / e.count : 0.0) << "\n";
+		}
+		out << std::left << std::setw(44) << "total" << std::right << std::setprecision(2) << std::setw(12)
+			<< mib(total()) << "\n";
+	}
+
+private:
+	std::map<std::string, entry> categories;
+	std::unordered_set<const void*> seen;
+};
+
+#endif
@@ -0,0 +1,447 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Streaming loaders for Wavefront OBJ and binary PLY files. Files are read in fixed-size blocks
+// straight into the vertex and index buffers of a triangle_mesh; polygons are triangulated as
+// fans. On failure the loaders report the problem on std::cerr and return nullptr.
+
+class mesh_file_reader
+{
+public:
+	explicit mesh_file_reader(const std::string& path) : file(std::fopen(path.c_str(), "rb")), buffer(1 << 20)
+	{
+	}
+
+	~mesh_file_reader()
+	{
+		if (file)
+			std::fclose(file);
+	}
+
+	mesh_file_reader(const mesh_file_reader&) = delete;
+	mesh_file_reader& operator=(const mesh_file_reader&) = delete;
+
+	bool is_open() const { return file != nullptr; }
+
+	// Reads exactly `size` bytes, returning false at end of file.
+	bool read(void* destination, size_t size)
+	{
+		auto* out = static_cast<unsigned char*>(destination);
+		while (size > 0)
+		{
+			if (position == filled && !refill())
+				return false;
+			const size_t n = std::min(size, filled - position);
+			std::memcpy(out, buffer.data() + position, n);
+			position += n;
+			out += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	// Reads one line without its terminator, returning false at end of file.
+	bool read_line(std::string& line)
+	{
+		line.clear();
+		while (true)
+		{
+			if (position == filled && !refill())
+				return !line.empty();
+			const char* begin = buffer.data() + position;
+			const auto* newline = static_cast<const char*>(std::memchr(begin, '\n', filled - position));
+			if (newline)
+			{
+				line.append(begin, newline);
+				position += newline - begin + 1;
+				if (!line.empty() && line.back() == '\r')
+					line.pop_back();
+				return true;
+			}
+			line.append(begin, filled - position);
+			position = filled;
+		}
+	}
+
+private:
+	std::FILE* file;
+	std::vector<char> buffer;
+	size_t position = 0;
+	size_t filled = 0;
+
+	bool refill()
+	{
+		if (!file)
+			return false;
+		filled = std::fread(buffer.data(), 1, buffer.size(), file);
+		position = 0;
+		return filled > 0;
+	}
+};
+
+namespace mesh_loader_detail
+{
+	inline const char* skip_spaces(const char* p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		return p;
+	}
+
+	inline bool parse_float(const char*& p, const char* end, float& value)
+	{
+		p = skip_spaces(p, end);
+		if (p < end && *p == '+')
+			p++;
+		const auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc())
+			return false;
+		p = result.ptr;
+		return true;
+	}
+
+	// Parses the vertex index of an OBJ face corner ("v", "v/vt", "v//vn" or "v/vt/vn"),
+	// resolving negative (relative) indices against the current vertex count.
+	inline bool parse_face_index(const char*& p, const char* end, const size_t vertex_count, uint32_t& index)
+	{
+		long long value;
+		const auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc() || value == 0)
+			return false;
+		p = result.ptr;
+		while (p < end && *p != ' ' && *p != '\t')
+			p++;
+
+		value = value < 0 ? static_cast<long long>(vertex_count) + value : value - 1;
+		if (value < 0 || value >= static_cast<long long>(vertex_count))
+			return false;
+		index = static_cast<uint32_t>(value);
+		return true;
+	}
+
+	inline void append_fan(std::vector<uint32_t>& indices, const std::vector<uint32_t>& polygon)
+	{
+		for (size_t k = 2; k < polygon.size(); k++)
+		{
+			indices.push_back(polygon[0]);
+			indices.push_back(polygon[k - 1]);
+			indices.push_back(polygon[k]);
+		}
+	}
+
+	inline bool host_is_little_endian()
+	{
+		const uint16_t probe = 1;
+		unsigned char first;
+		std::memcpy(&first, &probe, 1);
+		return first == 1;
+	}
+}
+
+inline shared_ptr<triangle_mesh> load_obj(const std::string& path, shared_ptr<material> mat)
+{
+	using namespace mesh_loader_detail;
+
+	mesh_file_reader reader(path);
+	if (!reader.is_open())
+	{
+		std::cerr << "Failed to open mesh file " << path << "\n";
+		return nullptr;
+	}
+
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> polygon;
+	std::string line;
+	size_t line_number = 0;
+
+	while (reader.read_line(line))
+	{
+		line_number++;
+		const char* p = line.data();
+		const char* end = p + line.size();
+		p = skip_spaces(p, end);
+		if (end - p < 2 || (p[1] != ' ' && p[1] != '\t'))
+			continue; // Blank lines, comments and statements we don't use (vt, vn, o, usemtl, ...)
+
+		if (p[0] == 'v')
+		{
+			float xyz[3];
+			p++;
+			if (!parse_float(p, end, xyz[0]) || !parse_float(p, end, xyz[1]) || !parse_float(p, end, xyz[2]))
+			{
+				std::cerr << path << ":" << line_number << ": malformed vertex\n";
+				return nullptr;
+			}
+			positions.insert(positions.end(), xyz, xyz + 3);
+		}
+		else if (p[0] == 'f')
+		{
+			polygon.clear();
+			p++;
+			while ((p = skip_spaces(p, end)) < end)
+			{
+				uint32_t index;
+				if (!parse_face_index(p, end, positions.size() / 3, index))
+				{
+					std::cerr << path << ":" << line_number << ": malformed face\n";
+					return nullptr;
+				}
+				polygon.push_back(index);
+			}
+			append_fan(indices, polygon);
+		}
+	}
+
+	positions.shrink_to_fit();
+	indices.shrink_to_fit();
+	return make_shared<triangle_mesh>(std::move(positions), std::move(indices), mat);
+}
+
+inline shared_ptr<triangle_mesh> load_ply(const std::string& path, shared_ptr<material> mat)
+{
+	using namespace mesh_loader_detail;
+
+	struct property
+	{
+		std::string name;
+		int size = 0; // Size of the value, or of each list item for list properties
+		char kind = 'f'; // 'f' floating point, 'i' signed or 'u' unsigned integer
+		bool is_list = false;
+		int count_size = 0; // Size of the list length prefix
+	};
+
+	struct element
+	{
+		std::string name;
+		size_t count = 0;
+		std::vector<property> properties;
+	};
+
+	auto type_info = [](const std::string& type, int& size, char& kind)
+	{
+		static const struct
+		{
+			const char* name;
+			int size;
+			char kind;
+		} types[] = {
+			{"char", 1, 'i'}, {"int8", 1, 'i'}, {"uchar", 1, 'u'}, {"uint8", 1, 'u'},
+			{"short", 2, 'i'}, {"int16", 2, 'i'}, {"ushort", 2, 'u'}, {"uint16", 2, 'u'},
+			{"int", 4, 'i'}, {"int32", 4, 'i'}, {"uint", 4, 'u'}, {"uint32", 4, 'u'},
+			{"float", 4, 'f'}, {"float32", 4, 'f'}, {"double", 8, 'f'}, {"float64", 8, 'f'},
+		};
+		for (const auto& t : types)
+		{
+			if (type == t.name)
+			{
+				size = t.size;
+				kind = t.kind;
+				return true;
+			}
+		}
+		return false;
+	};
+
+	mesh_file_reader reader(path);
+	if (!reader.is_open())
+	{
+		std::cerr << "Failed to open mesh file " << path << "\n";
+		return nullptr;
+	}
+
+	std::string line;
+	if (!reader.read_line(line) || line != "ply")
+	{
+		std::cerr << path << ": not a PLY file\n";
+		return nullptr;
+	}
+
+	bool swap_bytes = false;
+	std::vector<element> elements;
+	while (true)
+	{
+		if (!reader.read_line(line))
+		{
+			std::cerr << path << ": truncated PLY header\n";
+			return nullptr;
+		}
+
+		std::istringstream words(line);
+		std::string keyword;
+		words >> keyword;
+		if (keyword == "end_header")
+			break;
+
+		if (keyword == "format")
+		{
+			std::string format;
+			words >> format;
+			if (format == "binary_little_endian")
+				swap_bytes = !host_is_little_endian();
+			else if (format == "binary_big_endian")
+				swap_bytes = host_is_little_endian();
+			else
+			{
+				std::cerr << path << ": unsupported PLY format " << format << " (only binary is supported)\n";
+				return nullptr;
+			}
+		}
+		else if (keyword == "element")
+		{
+			element e;
+			words >> e.name >> e.count;
+			elements.push_back(e);
+		}
+		else if (keyword == "property" && !elements.empty())
+		{
+			property prop;
+			std::string type;
+			words >> type;
+			if (type == "list")
+			{
+				std::string count_type, item_type;
+				words >> count_type >> item_type;
+				char count_kind;
+				prop.is_list = true;
+				if (!type_info(count_type, prop.count_size, count_kind) || count_kind == 'f'
+					|| !type_info(item_type, prop.size, prop.kind))
+				{
+					std::cerr << path << ": unsupported PLY list type\n";
+					return nullptr;
+				}
+			}
+			else if (!type_info(type, prop.size, prop.kind))
+			{
+				std::cerr << path << ": unsupported PLY property type " << type << "\n";
+				return nullptr;
+			}
+			words >> prop.name;
+			elements.back().properties.push_back(prop);
+		}
+	}
+
+	auto read_value = [&](const int size, const char kind, double& value)
+	{
+		unsigned char bytes[8];
+		if (!reader.read(bytes, size))
+			return false;
+		if (swap_bytes)
+			std::reverse(bytes, bytes + size);
+
+		switch (size * 4 + (kind == 'f' ? 0 : kind == 'i' ? 1 : 2))
+		{
+		case 4 + 1: value = static_cast<int8_t>(bytes[0]); break;
+		case 4 + 2: value = bytes[0]; break;
+		case 8 + 1: { int16_t x; std::memcpy(&x, bytes, 2); value = x; break; }
+		case 8 + 2: { uint16_t x; std::memcpy(&x, bytes, 2); value = x; break; }
+		case 16 + 0: { float x; std::memcpy(&x, bytes, 4); value = x; break; }
+		case 16 + 1: { int32_t x; std::memcpy(&x, bytes, 4); value = x; break; }
+		case 16 + 2: { uint32_t x; std::memcpy(&x, bytes, 4); value = x; break; }
+		case 32 + 0: { double x; std::memcpy(&x, bytes, 8); value = x; break; }
+		default: return false;
+		}
+		return true;
+	};
+
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> polygon;
+	size_t vertex_count = 0;
+
+	for (const auto& e : elements)
+	{
+		const bool is_vertex = e.name == "vertex";
+		const bool is_face = e.name == "face";
+		if (is_vertex)
+		{
+			vertex_count = e.count;
+			positions.reserve(3 * e.count);
+		}
+		else if (is_face)
+			indices.reserve(3 * e.count);
+
+		for (size_t n = 0; n < e.count; n++)
+		{
+			float xyz[3] = {0, 0, 0};
+			for (const auto& prop : e.properties)
+			{
+				double value;
+				if (!prop.is_list)
+				{
+					if (!read_value(prop.size, prop.kind, value))
+					{
+						std::cerr << path << ": truncated PLY data\n";
+						return nullptr;
+					}
+					if (is_vertex && prop.name.size() == 1 && prop.name[0] >= 'x' && prop.name[0] <= 'z')
+						xyz[prop.name[0] - 'x'] = static_cast<float>(value);
+					continue;
+				}
+
+				double length;
+				if (!read_value(prop.count_size, 'u', length))
+				{
+					std::cerr << path << ": truncated PLY data\n";
+					return nullptr;
+				}
+
+				const bool is_index_list = is_face && (prop.name == "vertex_indices" || prop.name == "vertex_index");
+				polygon.clear();
+				for (size_t k = 0; k < static_cast<size_t>(length); k++)
+				{
+					if (!read_value(prop.size, prop.kind, value))
+					{
+						std::cerr << path << ": truncated PLY data\n";
+						return nullptr;
+					}
+					if (is_index_list)
+					{
+						if (value < 0 || value >= static_cast<double>(vertex_count))
+						{
+							std::cerr << path << ": PLY face index out of range\n";
+							return nullptr;
+						}
+						polygon.push_back(static_cast<uint32_t>(value));
+					}
+				}
+				if (is_index_list)
+					append_fan(indices, polygon);
+			}
+			if (is_vertex)
+				positions.insert(positions.end(), xyz, xyz + 3);
+		}
+	}
+
+	indices.shrink_to_fit();
+	return make_shared<triangle_mesh>(std::move(positions), std::move(indices), mat);
+}
+
+// Picks the loader from the file extension.
+inline shared_ptr<triangle_mesh> load_mesh(const std::string& path, shared_ptr<material> mat)
+{
+	const auto extension_start = path.find_last_of('.');
+	std::string extension = extension_start == std::string::npos ? "" : path.substr(extension_start + 1);
+	for (auto& ch : extension)
+		ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+
+	if (extension == "obj")
+		return load_obj(path, mat);
+	if (extension == "ply")
+		return load_ply(path, mat);
+
+	std::cerr << "Unsupported mesh format: " << path << "\n";
+	return nullptr;
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define METAL_H
 
 #include "material_base.h"
+#include "texture.h"
 
 class metal : public material
 {
@@ -10,18 +11,30 @@ public:
 	{
 	}
 
-	bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
+	metal(shared_ptr<texture> tex, const double fuzz) : tex(tex), fuzz(fuzz < 1 ? fuzz : 1)
+	{
+	}
+
+	bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered, sampler& s)
 	const override
 	{
 		vec3 reflected = reflect(r_in.direction(), rec.normal);
-		reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
-		scattered = ray(rec.p, reflected);
-		attenuation = albedo;
+		const sample2 u = s.get_2d();
+		reflected = unit_vector(reflected) + (fuzz * sample_unit_vector(u.x, u.y));
+		scattered = ray(rec.p, reflected, r_in.time());
+		attenuation = tex ? tex->value(rec) : albedo;
 		return (dot(scattered.direction(), rec.normal) > 0);
 	}
 
+	void account(memory_report& report) const override
+	{
+		report.add("material: metal", sizeof(*this));
+		report.add_shared(tex.get());
+	}
+
 private:
 	color albedo;
+	shared_ptr<texture> tex; // Overrides albedo when set
 	double fuzz;
 };
 
@@ -0,0 +1,252 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "net.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// Counters of one render thread, on a cache line of their own. Only the owning thread writes
+// them, once per tile; readers load them relaxed, so nothing on the render path waits.
+struct alignas(64) thread_counters
+{
+	std::atomic<uint64_t> rays{0};
+	std::atomic<uint64_t> samples{0};
+	std::atomic<uint64_t> tiles{0};
+	std::atomic<uint64_t> busy_ns{0}; // Time spent rendering tiles
+	std::atomic<bool> working{false}; // Holds a tile right now
+
+	void add(std::atomic<uint64_t>& counter, const uint64_t amount)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+};
+
+// Progress of a render, gathered from per-thread counters.
+class render_metrics
+{
+public:
+	render_metrics(const int thread_count, const size_t total_tiles, const uint64_t total_samples)
+		: counters(new thread_counters[thread_count]), thread_count(thread_count), total_tiles(total_tiles),
+		  total_samples(total_samples), start(std::chrono::steady_clock::now())
+	{
+	}
+
+	thread_counters& thread(const int index) { return counters[index]; }
+
+	struct snapshot
+	{
+		double elapsed = 0; // Seconds
+		uint64_t rays = 0;
+		uint64_t samples = 0;
+		size_t tiles_done = 0;
+		size_t queue_depth = 0; // Tiles no thread has started yet
+		double rays_per_second = 0;
+		double eta = 0; // Seconds left, extrapolated from the sample rate so far
+		std::vector<double> utilization; // Fraction of the elapsed time each thread was rendering
+	};
+
+	snapshot read() const
+	{
+		snapshot s;
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		s.elapsed = std::chrono::duration<double>(elapsed).count();
+		const auto elapsed_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+		size_t in_flight = 0;
+		for (int t = 0; t < thread_count; t++)
+		{
+			const thread_counters& c = counters[t];
+			s.rays += c.rays.load(std::memory_order_relaxed);
+			s.samples += c.samples.load(std::memory_order_relaxed);
+			s.tiles_done += c.tiles.load(std::memory_order_relaxed);
+			in_flight += c.working.load(std::memory_order_relaxed) ? 1 : 0;
+			s.utilization.push_back(elapsed_ns > 0 ? c.busy_ns.load(std::memory_order_relaxed) / elapsed_ns : 0.0);
+		}
+
+		s.queue_depth = total_tiles > s.tiles_done + in_flight ? total_tiles - s.tiles_done - in_flight : 0;
+		s.rays_per_second = s.elapsed > 0 ? s.rays / s.elapsed : 0.0;
+		s.eta = s.samples > 0 ? s.elapsed * static_cast<double>(total_samples - s.samples) / s.samples : 0.0;
+		return s;
+	}
+
+	std::string json() const
+	{
+		const snapshot s = read();
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(3)
+			<< "{\n"
+			<< "  \"elapsed_seconds\": " << s.elapsed << ",\n"
+			<< "  \"eta_seconds\": " << s.eta << ",\n"
+			<< "  \"rays\": " << s.rays << ",\n"
+			<< "  \"rays_per_second\": " << s.rays_per_second << ",\n"
+			<< "  \"samples_done\": " << s.samples << ",\n"
+			<< "  \"samples_total\": " << total_samples << ",\n"
+			<< "  \"tiles_done\": " << s.tiles_done << ",\n"
+			<< "  \"tiles_total\": " << total_tiles << ",\n"
+			<< "  \"queue_depth\": " << s.queue_depth << ",\n"
+			<< "  \"thread_utilization\": [";
+		for (size_t t = 0; t < s.utilization.size(); t++)
+			out << (t ? ", " : "") << s.utilization[t];
+		out << "]\n}\n";
+		return out.str();
+	}
+
+	// Prometheus text exposition format.
+	std::string prometheus() const
+	{
+		const snapshot s = read();
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(3)
+			<< "# TYPE render_rays_total counter\nrender_rays_total " << s.rays << "\n"
+			<< "# TYPE render_rays_per_second gauge\nrender_rays_per_second " << s.rays_per_second << "\n"
+			<< "# TYPE render_samples_done counter\nrender_samples_done " << s.samples << "\n"
+			<< "# TYPE render_samples_total gauge\nrender_samples_total " << total_samples << "\n"
+			<< "# TYPE render_tiles_done counter\nrender_tiles_done " << s.tiles_done << "\n"
+			<< "# TYPE render_queue_depth gauge\nrender_queue_depth " << s.queue_depth << "\n"
+			<< "# TYPE render_eta_seconds gauge\nrender_eta_seconds " << s.eta << "\n"
+			<< "# TYPE render_thread_utilization gauge\n";
+		for (size_t t = 0; t < s.utilization.size(); t++)
+			out << "render_thread_utilization{thread=\"" << t << "\"} " << s.utilization[t] << "\n";
+		return out.str();
+	}
+
+	std::string progress_line() const
+	{
+		const snapshot s = read();
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(2) << "Progress: "
+			<< (total_samples > 0 ? 100.0 * s.samples / total_samples : 100.0) << "% complete, "
+			<< s.rays_per_second / 1e6 << " Mrays/s, ETA " << std::setprecision(0) << s.eta << "s";
+		return out.str();
+	}
+
+private:
+	std::unique_ptr<thread_counters[]> counters;
+	int thread_count;
+	size_t total_tiles;
+	uint64_t total_samples;
+	std::chrono::steady_clock::time_point start;
+};
+
+// Publishes render_metrics while a render runs: the progress line on std::clog, optionally a
+// JSON status file rewritten every second and a Prometheus endpoint on localhost. Runs on its
+// own thread from construction until stop() or destruction.
+class metrics_reporter
+{
+public:
+	metrics_reporter(const render_metrics& metrics, std::string status_path, const int metrics_port)
+		: metrics(metrics), status_path(std::move(status_path))
+	{
+		if (metrics_port > 0)
+		{
+			listener = tcp_socket::listen(static_cast<uint16_t>(metrics_port), true);
+			if (!listener.valid())
+				std::cerr << "Failed to serve metrics on port " << metrics_port << "\n";
+		}
+		reporter = std::thread([this] { run(); });
+	}
+
+	~metrics_reporter()
+	{
+		stop();
+	}
+
+	void stop()
+	{
+		if (!reporter.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(stop_mutex);
+			stopping = true;
+		}
+		stop_signal.notify_all();
+		reporter.join();
+		publish();
+	}
+
+private:
+	// The endpoint is polled, so stop() waits for at most one poll.
+	static constexpr int poll_milliseconds = 50;
+
+	const render_metrics& metrics;
+	std::string status_path;
+	tcp_socket listener;
+	std::mutex stop_mutex;
+	std::condition_variable stop_signal;
+	bool stopping = false;
+	std::thread reporter;
+
+	void run()
+	{
+		auto last_publish = std::chrono::steady_clock::now();
+		while (true)
+		{
+			if (listener.valid())
+			{
+				if (listener.wait_readable(poll_milliseconds))
+					serve(listener.accept());
+			}
+
+			{
+				// Without an endpoint to poll, sleep until the next publish or stop().
+				std::unique_lock<std::mutex> lock(stop_mutex);
+				if (!listener.valid())
+					stop_signal.wait_until(lock, last_publish + std::chrono::seconds(1), [&] { return stopping; });
+				if (stopping)
+					break;
+			}
+
+			const auto now = std::chrono::steady_clock::now();
+			if (now - last_publish >= std::chrono::seconds(1))
+			{
+				publish();
+				last_publish = now;
+			}
+		}
+	}
+
+	void publish() const
+	{
+		std::clog << "\r\033[K" << metrics.progress_line() << std::flush;
+
+		if (status_path.empty())
+			return;
+
+		// Replace the file in one step, so readers never see a half-written status.
+		const std::string temporary = status_path + ".tmp";
+		{
+			std::ofstream out(temporary, std::ios::trunc);
+			out << metrics.json();
+		}
+		std::remove(status_path.c_str());
+		std::rename(temporary.c_str(), status_path.c_str());
+	}
+
+	void serve(tcp_socket client) const
+	{
+		if (!client.valid())
+			return;
+
+		// Any request gets the metrics; the request itself only needs to be drained.
+		client.set_receive_timeout(1);
+		char request[1024];
+		client.receive_some(request, sizeof(request));
+
+		const std::string body = metrics.prometheus();
+		const std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+			+ std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+		client.send_all(response.data(), response.size());
+	}
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef MOVING_H
+#define MOVING_H
+
+#include "hittable.h"
+
+// An object moving at constant velocity: at time t it is offset by t * velocity. Works for any
+// hittable (cubes, quads, meshes, whole lists); spheres can also move on their own.
+class moving final : public hittable
+{
+public:
+	moving(shared_ptr<hittable> object, const vec3& velocity) : object(object), velocity(velocity)
+	{
+		aabb start, end;
+		object->motion_bounds(start, end);
+		bbox = aabb(start, end + velocity);
+	}
+
+	bool hit(const ray& r, const interval ray_t, hit_record& rec) const override
+	{
+		// Move the ray instead of the object. The direction is unchanged, so t is the same.
+		const vec3 offset = r.time() * velocity;
+		if (!object->hit(ray(r.origin() - offset, r.direction(), r.time()), ray_t, rec))
+			return false;
+
+		rec.p += offset;
+		return true;
+	}
+
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		return object->occluded(ray(r.origin() - r.time() * velocity, r.direction(), r.time()), ray_t);
+	}
+
+	aabb bounding_box() const override { return bbox; }
+
+	void motion_bounds(aabb& start, aabb& end) const override
+	{
+		object->motion_bounds(start, end);
+		end = end + velocity;
+	}
+
+	void account(memory_report& report) const override
+	{
+		report.add("primitive: moving", sizeof(*this));
+		report.add_shared(object.get());
+	}
+
+	void compact() override { object->compact(); }
+
+private:
+	shared_ptr<hittable> object;
+	vec3 velocity; // Distance moved by time 1
+	aabb bbox;
+};
+
+#endif
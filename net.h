@@ -0,0 +1,270 @@
+#ifndef NET_H
+#define NET_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+// Keep windows.h from defining min and max macros, which break std::min and std::max.
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+// Minimal blocking TCP socket over Winsock and BSD sockets. Errors are reported through return
+// values; the socket is closed when the object goes away.
+class tcp_socket
+{
+public:
+#ifdef _WIN32
+	using handle_type = SOCKET;
+	static constexpr handle_type invalid_handle = INVALID_SOCKET;
+#else
+	using handle_type = int;
+	static constexpr handle_type invalid_handle = -1;
+#endif
+
+	tcp_socket() = default;
+
+	explicit tcp_socket(const handle_type handle) : handle(handle)
+	{
+	}
+
+	~tcp_socket()
+	{
+		close();
+	}
+
+	tcp_socket(tcp_socket&& other) noexcept : handle(other.handle)
+	{
+		other.handle = invalid_handle;
+	}
+
+	tcp_socket& operator=(tcp_socket&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+			handle = other.handle;
+			other.handle = invalid_handle;
+		}
+		return *this;
+	}
+
+	tcp_socket(const tcp_socket&) = delete;
+	tcp_socket& operator=(const tcp_socket&) = delete;
+
+	bool valid() const { return handle != invalid_handle; }
+
+	void close()
+	{
+		if (!valid())
+			return;
+#ifdef _WIN32
+		closesocket(handle);
+#else
+		::close(handle);
+#endif
+		handle = invalid_handle;
+	}
+
+	// Connects to host:port; returns an invalid socket on failure.
+	static tcp_socket connect(const std::string& host, const uint16_t port)
+	{
+		if (!startup())
+			return tcp_socket();
+
+		addrinfo hints = {};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo* results = nullptr;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &results) != 0)
+			return tcp_socket();
+
+		tcp_socket s;
+		for (const addrinfo* a = results; a; a = a->ai_next)
+		{
+			s = tcp_socket(socket(a->ai_family, a->ai_socktype, a->ai_protocol));
+			if (s.valid() && ::connect(s.handle, a->ai_addr, static_cast<int>(a->ai_addrlen)) == 0)
+				break;
+			s.close();
+		}
+		freeaddrinfo(results);
+
+		if (s.valid())
+			s.set_no_delay();
+		return s;
+	}
+
+	// Listens on all interfaces, or only on 127.0.0.1; returns an invalid socket on failure.
+	static tcp_socket listen(const uint16_t port, const bool loopback_only = false)
+	{
+		if (!startup())
+			return tcp_socket();
+
+		tcp_socket s(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+		if (!s.valid())
+			return s;
+
+		const int reuse = 1;
+		setsockopt(s.handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(loopback_only ? INADDR_LOOPBACK : INADDR_ANY);
+		address.sin_port = htons(port);
+		if (bind(s.handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+			|| ::listen(s.handle, SOMAXCONN) != 0)
+		{
+			s.close();
+		}
+		return s;
+	}
+
+	tcp_socket accept() const
+	{
+		tcp_socket client(::accept(handle, nullptr, nullptr));
+		if (client.valid())
+			client.set_no_delay();
+		return client;
+	}
+
+	// Waits up to `milliseconds` for the socket to become readable (or, when listening, for a
+	// pending connection).
+	bool wait_readable(const int milliseconds) const
+	{
+		fd_set set;
+		FD_ZERO(&set);
+		FD_SET(handle, &set);
+		timeval timeout = {milliseconds / 1000, (milliseconds % 1000) * 1000};
+		return select(static_cast<int>(handle + 1), &set, nullptr, nullptr, &timeout) > 0;
+	}
+
+	// Makes receive_all fail when the peer stays silent for this long; 0 waits forever.
+	void set_receive_timeout(const int seconds)
+	{
+#ifdef _WIN32
+		const DWORD timeout = seconds * 1000;
+#else
+		const timeval timeout = {seconds, 0};
+#endif
+		setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+	}
+
+	bool send_all(const void* data, size_t size)
+	{
+		const char* p = static_cast<const char*>(data);
+		while (size > 0)
+		{
+			const int chunk = size > (1u << 30) ? (1 << 30) : static_cast<int>(size);
+#ifdef _WIN32
+			const int sent = send(handle, p, chunk, 0);
+#else
+			// No SIGPIPE when the peer has gone away; the error is returned instead.
+			const auto sent = static_cast<int>(send(handle, p, chunk, MSG_NOSIGNAL));
+#endif
+			if (sent <= 0)
+				return false;
+			p += sent;
+			size -= sent;
+		}
+		return true;
+	}
+
+	// Receives whatever has arrived, up to `size` bytes. Returns the byte count, 0 on failure.
+	size_t receive_some(void* data, const size_t size)
+	{
+		const int chunk = size > (1u << 30) ? (1 << 30) : static_cast<int>(size);
+		const auto received = static_cast<int>(recv(handle, static_cast<char*>(data), chunk, 0));
+		return received > 0 ? static_cast<size_t>(received) : 0;
+	}
+
+	bool receive_all(void* data, size_t size)
+	{
+		char* p = static_cast<char*>(data);
+		while (size > 0)
+		{
+			const int chunk = size > (1u << 30) ? (1 << 30) : static_cast<int>(size);
+			const auto received = static_cast<int>(recv(handle, p, chunk, 0));
+			if (received <= 0)
+				return false;
+			p += received;
+			size -= received;
+		}
+		return true;
+	}
+
+private:
+	handle_type handle = invalid_handle;
+
+	void set_no_delay()
+	{
+		const int on = 1;
+		setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof(on));
+	}
+
+	static bool startup()
+	{
+#ifdef _WIN32
+		static const bool started = []
+		{
+			WSADATA data;
+			return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}();
+		if (!started)
+			std::cerr << "Failed to initialize Winsock\n";
+		return started;
+#else
+		return true;
+#endif
+	}
+};
+
+// Fixed-width integers and floats travel in network byte order.
+
+inline void put_u32(std::string& buffer, const uint32_t v)
+{
+	const uint32_t n = htonl(v);
+	buffer.append(reinterpret_cast<const char*>(&n), sizeof(n));
+}
+
+inline uint32_t get_u32(const char* p)
+{
+	uint32_t n;
+	std::memcpy(&n, p, sizeof(n));
+	return ntohl(n);
+}
+
+inline uint32_t float_bits(const float f)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+inline float bits_float(const uint32_t bits)
+{
+	float f;
+	std::memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+#endif
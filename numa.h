@@ -0,0 +1,150 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include "hittable.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+// Keep windows.h from defining min and max macros, which break std::min and std::max.
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Where a render thread runs: a NUMA node and one of its CPUs.
+struct thread_placement
+{
+	int node;
+	int cpu;
+};
+
+// The machine's NUMA nodes and the logical CPUs of each. Machines (or platforms) without NUMA
+// information show up as a single node holding every CPU.
+class numa_topology
+{
+public:
+	std::vector<std::vector<int>> node_cpus;
+
+	static numa_topology detect()
+	{
+		numa_topology topology;
+#ifdef _WIN32
+		ULONG highest = 0;
+		if (GetNumaHighestNodeNumber(&highest))
+		{
+			for (ULONG node = 0; node <= highest; node++)
+			{
+				// Only processor group 0 is considered, which covers up to 64 logical CPUs.
+				ULONGLONG mask = 0;
+				std::vector<int> cpus;
+				if (GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask))
+				{
+					for (int cpu = 0; cpu < 64; cpu++)
+					{
+						if (mask & (1ull << cpu))
+							cpus.push_back(cpu);
+					}
+				}
+				if (!cpus.empty())
+					topology.node_cpus.push_back(cpus);
+			}
+		}
+#else
+		for (const int node : read_cpu_list("/sys/devices/system/node/online"))
+		{
+			std::vector<int> cpus = read_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			if (!cpus.empty())
+				topology.node_cpus.push_back(cpus);
+		}
+#endif
+		if (topology.node_cpus.empty())
+		{
+			const int count = std::max(1u, std::thread::hardware_concurrency());
+			topology.node_cpus.emplace_back();
+			for (int cpu = 0; cpu < count; cpu++)
+				topology.node_cpus[0].push_back(cpu);
+		}
+		return topology;
+	}
+
+	int node_count() const { return static_cast<int>(node_cpus.size()); }
+
+	// Threads go round-robin over the nodes, so even a few threads use every socket, and then
+	// over each node's CPUs.
+	thread_placement place_thread(const int thread_index) const
+	{
+		const int node = thread_index % node_count();
+		const std::vector<int>& cpus = node_cpus[node];
+		return {node, cpus[(thread_index / node_count()) % cpus.size()]};
+	}
+
+private:
+	// Parses the kernel's CPU list format, e.g. "0-3,8-11".
+	static std::vector<int> read_cpu_list(const std::string& path)
+	{
+		std::vector<int> values;
+		std::ifstream in(path);
+		std::string range;
+		while (std::getline(in, range, ','))
+		{
+			std::istringstream parse(range);
+			int first, last;
+			char dash;
+			if (!(parse >> first))
+				continue;
+			if (!(parse >> dash >> last))
+				last = first;
+			for (int v = first; v <= last; v++)
+				values.push_back(v);
+		}
+		return values;
+	}
+};
+
+// Binds the calling thread to one logical CPU. Returns false if the platform refuses.
+inline bool pin_current_thread(const int cpu)
+{
+#ifdef _WIN32
+	return cpu < 64 && SetThreadAffinityMask(GetCurrentThread(), 1ull << cpu) != 0;
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+// Builds one copy of the scene per NUMA node by calling `build` on a thread pinned to that
+// node. Memory is placed on the node that first touches it, so each replica, acceleration
+// structures included, ends up local to the render threads that will read it.
+template <typename Build>
+std::vector<shared_ptr<hittable>> build_node_replicas(const numa_topology& topology, Build&& build)
+{
+	std::vector<shared_ptr<hittable>> replicas(topology.node_count());
+	std::vector<std::thread> builders;
+	for (int node = 0; node < topology.node_count(); node++)
+	{
+		builders.emplace_back([&, node]
+		{
+			pin_current_thread(topology.node_cpus[node].front());
+			replicas[node] = build();
+		});
+	}
+	for (auto& builder : builders)
+		builder.join();
+	return replicas;
+}
+
+#endif
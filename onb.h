@@ -0,0 +1,37 @@
+#ifndef ONB_H
+#define ONB_H
+
+#include "utilities.h"
+
+// Orthonormal basis around a unit vector w, for turning directions sampled around +z into
+// world space.
+class onb
+{
+public:
+	explicit onb(const vec3& n)
+	{
+		// Branch-free construction (Duff et al. 2017, "Building an Orthonormal Basis, Revisited"),
+		// continuous everywhere except across the z = 0 plane and without a normalization.
+		const auto sign = std::copysign(1.0, n.z());
+		const auto a = -1.0 / (sign + n.z());
+		const auto b = n.x() * n.y() * a;
+		axis[0] = vec3(1.0 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+		axis[1] = vec3(b, sign + n.y() * n.y() * a, -n.y());
+		axis[2] = n;
+	}
+
+	const vec3& u() const { return axis[0]; }
+	const vec3& v() const { return axis[1]; }
+	const vec3& w() const { return axis[2]; }
+
+	vec3 transform(const vec3& v) const
+	{
+		// Transform from basis coordinates to local space.
+		return (v[0] * axis[0]) + (v[1] * axis[1]) + (v[2] * axis[2]);
+	}
+
+private:
+	vec3 axis[3];
+};
+
+#endif
@@ -2,12 +2,15 @@
 #define PLANE_H
 
 #include "hittable.h"
+#include "material_base.h"
+#include "onb.h"
 
-class plane : public hittable
+class plane final : public hittable
 {
 public:
-	plane(const vec3& p0, const vec3& normal, shared_ptr<material> mat)
-		: p0(p0), normal(normal), mat(mat)
+	// Textures repeat every `texture_size` units across the plane.
+	plane(const vec3& p0, const vec3& normal, shared_ptr<material> mat, const double texture_size = 1)
+		: p0(p0), normal(normal), mat(mat), axes(unit_vector(normal)), texture_size(texture_size)
 	{
 	}
 
@@ -23,17 +26,39 @@ public:
 				rec.t = t;
 				rec.p = r.at(t);
 				rec.set_face_normal(r, normal);
-				rec.mat = mat;
+				rec.u = dot(rec.p - p0, axes.u()) / texture_size;
+				rec.v = dot(rec.p - p0, axes.v()) / texture_size;
+				rec.uv_per_length = 1 / texture_size;
+				rec.mat = mat.get();
 				return true;
 			}
 		}
 		return false;
 	}
 
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		const auto denom = dot(normal, r.direction());
+		if (fabs(denom) <= 1e-6)
+			return false;
+
+		return ray_t.surrounds(dot(p0 - r.origin(), normal) / denom);
+	}
+
+	aabb bounding_box() const override { return aabb::universe; }
+
+	void account(memory_report& report) const override
+	{
+		report.add("primitive: plane", sizeof(*this));
+		report.add_shared(mat.get());
+	}
+
 private:
 	vec3 p0;
 	vec3 normal;
 	shared_ptr<material> mat;
+	onb axes; // In-plane directions of u and v
+	double texture_size;
 };
 
 #endif
@@ -0,0 +1,140 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "camera.h"
+
+#include <condition_variable>
+#include <sstream>
+
+// Interactive look-dev. The camera's preview image is rendered progressively: first a quarter
+// resolution image at one sample per pixel, then the full image one sample per pixel at a
+// time up to samples_per_pixel, each step replacing the preview file. Camera commands read
+// from stdin cancel the work in flight and start over; the scene stays loaded throughout.
+//
+// Commands, one per line:
+//   lookfrom x y z | lookat x y z | vfov degrees | defocus degrees | focus distance | quit
+
+namespace preview_detail
+{
+	// Nearest-neighbour enlargement of a coarse film, so the preview keeps its size.
+	inline film enlarge(const film& coarse, const int width, const int height)
+	{
+		film f(width, height);
+		for (int j = 0; j < height; j++)
+		{
+			const int cj = std::min(coarse.height - 1, j * coarse.height / height);
+			for (int i = 0; i < width; i++)
+			{
+				const size_t source = static_cast<size_t>(cj) * coarse.width + std::min(coarse.width - 1, i * coarse.width / width);
+				const size_t target = static_cast<size_t>(j) * width + i;
+				f.sample_counts[target] = coarse.sample_counts[source];
+				for (int k = 0; k < 3; k++)
+					f.sums[3 * target + k] = coarse.sums[3 * source + k];
+			}
+		}
+		return f;
+	}
+
+	// Applies one command to the camera. Returns false for lines it doesn't understand.
+	inline bool apply_command(const std::string& line, camera& cam)
+	{
+		std::istringstream in(line);
+		std::string command;
+		in >> command;
+
+		double x, y, z;
+		if (command == "lookfrom" && in >> x >> y >> z)
+			cam.lookfrom = vec3(x, y, z);
+		else if (command == "lookat" && in >> x >> y >> z)
+			cam.lookat = vec3(x, y, z);
+		else if (command == "vfov" && in >> x)
+			cam.vfov = x;
+		else if (command == "defocus" && in >> x)
+			cam.defocus_angle = x;
+		else if (command == "focus" && in >> x)
+			cam.focus_dist = x;
+		else
+			return false;
+		return true;
+	}
+}
+
+inline void run_interactive(const camera& initial, const hittable& world)
+{
+	using namespace preview_detail;
+
+	std::mutex mutex;
+	std::condition_variable changed_signal;
+	camera pending = initial;
+	bool changed = true;
+	bool quit = false;
+	std::atomic<bool> cancel(false);
+
+	if (pending.preview_path.empty())
+		pending.preview_path = "preview.png";
+	std::clog << "Interactive preview in " << pending.preview_path << "\n";
+
+	std::thread input([&]
+	{
+		std::string line;
+		while (std::getline(std::cin, line))
+		{
+			if (line == "quit")
+				break;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!apply_command(line, pending))
+			{
+				std::cerr << "Unknown command: " << line << "\n";
+				continue;
+			}
+			changed = true;
+			cancel = true;
+			changed_signal.notify_one();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+		cancel = true;
+		changed_signal.notify_one();
+	});
+
+	while (true)
+	{
+		camera view;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			changed_signal.wait(lock, [&] { return changed || quit; });
+			if (quit)
+				break;
+			view = pending;
+			changed = false;
+			cancel = false;
+		}
+
+		// Quick look: a quarter of the resolution, one sample per pixel.
+		view.checkpoint_path.clear();
+		camera coarse = view;
+		coarse.image_width = std::max(1, view.image_width / 4);
+		coarse.samples_per_pixel = 1;
+		coarse.sample_passes = 1;
+		coarse.preview_path.clear();
+		const film coarse_film = camera::render_views({&coarse}, world, {}, &cancel)[0];
+		if (cancel)
+			continue;
+		view.initialize();
+		view.preview_backdrop = enlarge(coarse_film, view.image_width, view.get_image_height());
+		view.write_png(view.preview_backdrop, view.preview_path);
+
+		// Then the full image, refined one sample per pixel at a time, over the quick look until
+		// the first pass reaches each pixel.
+		view.sample_passes = view.samples_per_pixel;
+		camera::render_views({&view}, world, {}, &cancel);
+		if (!cancel)
+			std::clog << "\r\033[KPreview converged\n";
+	}
+
+	input.join();
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef QUAD_H
+#define QUAD_H
+
+#include "hittable.h"
+#include "material_base.h"
+
+// The parallelogram Q + a u + b v for a, b in [0, 1].
+class quad final : public hittable
+{
+public:
+	// Textures stretch across the quad once, or repeat every `texture_size` units if given.
+	quad(const vec3& Q, const vec3& u, const vec3& v, shared_ptr<material> mat, const double texture_size = 0)
+		: Q(Q), u(u), v(v), mat(mat)
+	{
+		const vec3 n = cross(u, v);
+		normal = unit_vector(n);
+		D = dot(normal, Q);
+		w = n / dot(n, n);
+		bbox = aabb(aabb(Q, Q + u + v), aabb(Q + u, Q + v));
+
+		u_repeats = texture_size > 0 ? u.length() / texture_size : 1;
+		v_repeats = texture_size > 0 ? v.length() / texture_size : 1;
+		uv_per_length = texture_size > 0 ? 1 / texture_size : 1 / fmin(u.length(), v.length());
+	}
+
+	bool hit(const ray& r, const interval ray_t, hit_record& rec) const override
+	{
+		double t, alpha, beta;
+		if (!intersect(r, ray_t, t, alpha, beta))
+			return false;
+
+		rec.t = t;
+		rec.p = r.at(t);
+		rec.set_face_normal(r, normal);
+		rec.u = alpha * u_repeats;
+		rec.v = beta * v_repeats;
+		rec.uv_per_length = uv_per_length;
+		rec.mat = mat.get();
+		return true;
+	}
+
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		double t, alpha, beta;
+		return intersect(r, ray_t, t, alpha, beta);
+	}
+
+	aabb bounding_box() const override { return bbox; }
+
+	void account(memory_report& report) const override
+	{
+		report.add("primitive: quad", sizeof(*this));
+		report.add_shared(mat.get());
+	}
+
+private:
+	vec3 Q;
+	vec3 u, v;
+	vec3 w; // cross(u, v) / |cross(u, v)|^2, turns a point in the plane into its a, b
+	vec3 normal;
+	double D; // Plane equation: dot(normal, p) = D
+	shared_ptr<material> mat;
+	aabb bbox;
+	double u_repeats, v_repeats;
+	double uv_per_length;
+
+	// Hits the plane, then checks the hit point's coordinates along u and v.
+	bool intersect(const ray& r, const interval& ray_t, double& t, double& alpha, double& beta) const
+	{
+		const auto denom = dot(normal, r.direction());
+		if (fabs(denom) < 1e-8)
+			return false;
+
+		t = (D - dot(normal, r.origin())) / denom;
+		if (!ray_t.surrounds(t))
+			return false;
+
+		const vec3 planar = r.at(t) - Q;
+		alpha = dot(w, cross(planar, v));
+		beta = dot(w, cross(u, planar));
+		return alpha >= 0 && alpha <= 1 && beta >= 0 && beta <= 1;
+	}
+};
+
+#endif
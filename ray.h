@@ -10,12 +10,20 @@ public:
 	{
 	}
 
-	ray(const vec3& origin, const vec3& direction) : orig(origin), dir(direction)
+	ray(const vec3& origin, const vec3& direction, const double time = 0)
+		: orig(origin), dir(direction), inv_dir(1.0 / direction[0], 1.0 / direction[1], 1.0 / direction[2]),
+		  sign{inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0}, tm(time)
 	{
 	}
 
 	const vec3& origin() const { return orig; }
 	const vec3& direction() const { return dir; }
+	double time() const { return tm; } // When in the frame, from 0 to 1, the ray was sent
+
+	// Per-axis reciprocal of the direction and its sign bit (1 when negative), computed once per
+	// ray for the slab tests of every box the ray visits.
+	const vec3& inverse_direction() const { return inv_dir; }
+	int direction_sign(const int axis) const { return sign[axis]; }
 
 	vec3 at(const double t) const
 	{
@@ -25,6 +33,9 @@ public:
 private:
 	vec3 orig;
 	vec3 dir;
+	vec3 inv_dir;
+	int sign[3] = {0, 0, 0};
+	double tm = 0;
 };
 
 #endif
@@ -0,0 +1,364 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "utilities.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A pair of sample values in [0,1)^2.
+struct sample2
+{
+	double x, y;
+};
+
+// Hashing helpers shared by the samplers. All sample values are pure functions of the seed, the
+// pixel, the sample index and the dimension, so samplers carry no random state.
+
+inline uint64_t mix_bits(uint64_t v)
+{
+	v ^= v >> 31;
+	v *= 0x7fb5d329728ea185ull;
+	v ^= v >> 27;
+	v *= 0x81dadef4bc2dd44dull;
+	v ^= v >> 33;
+	return v;
+}
+
+inline uint64_t hash_values(const uint64_t a, const uint64_t b, const uint64_t c = 0, const uint64_t d = 0)
+{
+	uint64_t h = mix_bits(a + 0x9e3779b97f4a7c15ull);
+	h = mix_bits(h ^ (b + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2)));
+	h = mix_bits(h ^ (c + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2)));
+	return mix_bits(h ^ (d + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2)));
+}
+
+inline double bits_to_unit_double(const uint64_t bits)
+{
+	// Top 53 bits, so the result is exactly representable and strictly below 1.
+	return static_cast<double>(bits >> 11) * 0x1p-53;
+}
+
+inline double bits_to_unit_double(const uint32_t bits)
+{
+	return bits * 0x1p-32;
+}
+
+inline uint32_t reverse_bits(uint32_t v)
+{
+	v = (v << 16) | (v >> 16);
+	v = ((v & 0x00ff00ff) << 8) | ((v & 0xff00ff00) >> 8);
+	v = ((v & 0x0f0f0f0f) << 4) | ((v & 0xf0f0f0f0) >> 4);
+	v = ((v & 0x33333333) << 2) | ((v & 0xcccccccc) >> 2);
+	v = ((v & 0x55555555) << 1) | ((v & 0xaaaaaaaa) >> 1);
+	return v;
+}
+
+// Element i of a pseudo-random permutation of [0, n) selected by seed (Kensler 2013).
+inline uint32_t permutation_element(uint32_t i, const uint32_t n, const uint32_t seed)
+{
+	uint32_t w = n - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+	do
+	{
+		i ^= seed;
+		i *= 0xe170893d;
+		i ^= seed >> 16;
+		i ^= (i & w) >> 4;
+		i ^= seed >> 8;
+		i *= 0x0929eb3f;
+		i ^= seed >> 23;
+		i ^= (i & w) >> 1;
+		i *= 1 | seed >> 27;
+		i *= 0x6935fa69;
+		i ^= (i & w) >> 11;
+		i *= 0x74dcb303;
+		i ^= (i & w) >> 2;
+		i *= 0x9e501cc3;
+		i ^= (i & w) >> 2;
+		i *= 0xc860a3df;
+		i &= w;
+		i ^= i >> 5;
+	}
+	while (i >= n);
+	return (i + seed) % n;
+}
+
+// Source of sample values for the paths of one thread. The camera positions it on a pixel
+// sample, then draws dimensions in a fixed layout: the pixel jitter, the lens, and a block of
+// dimensions per bounce. Implementations map (seed, pixel, sample index, dimension) to a value.
+class sampler
+{
+public:
+	virtual ~sampler() = default;
+
+	void start_pixel_sample(const int x, const int y, const int sample_index)
+	{
+		pixel_seed = hash_values(static_cast<uint32_t>(x), static_cast<uint32_t>(y), seed);
+		index = sample_index;
+		dimension = 0;
+	}
+
+	// Jumps to a dimension, so a bounce draws from the same dimensions however many values
+	// the previous bounces consumed.
+	void set_dimension(const int d) { dimension = d; }
+
+	double get_1d()
+	{
+		return sample_1d(dimension++);
+	}
+
+	sample2 get_2d()
+	{
+		const sample2 u = sample_2d(dimension);
+		dimension += 2;
+		return u;
+	}
+
+protected:
+	int samples_per_pixel;
+	uint32_t seed = 0;
+	uint64_t pixel_seed = 0;
+	int index = 0;
+	int dimension = 0;
+
+	sampler(const int samples_per_pixel, const uint32_t seed) : samples_per_pixel(samples_per_pixel), seed(seed)
+	{
+	}
+
+	// Seed for one dimension of the current pixel.
+	uint32_t dimension_seed(const int d, const uint64_t salt = 0) const
+	{
+		return static_cast<uint32_t>(hash_values(pixel_seed, static_cast<uint64_t>(d), salt));
+	}
+
+	virtual double sample_1d(int d) = 0;
+	virtual sample2 sample_2d(int d) = 0;
+};
+
+// Uncorrelated uniform samples: plain Monte Carlo, the reference the others improve on.
+class independent_sampler : public sampler
+{
+public:
+	independent_sampler(const int samples_per_pixel, const uint32_t seed) : sampler(samples_per_pixel, seed)
+	{
+	}
+
+protected:
+	double sample_1d(const int d) override
+	{
+		return bits_to_unit_double(hash_values(pixel_seed, static_cast<uint64_t>(index), static_cast<uint64_t>(d)));
+	}
+
+	sample2 sample_2d(const int d) override
+	{
+		return {sample_1d(d), sample_1d(d + 1)};
+	}
+};
+
+// Jittered stratification for any sample count: 1D dimensions are split into
+// samples_per_pixel strata, 2D dimensions use correlated multi-jittering (Kensler 2013), which
+// stratifies the square and both of its projections. Strata are visited in a per-pixel,
+// per-dimension random order.
+class stratified_sampler : public sampler
+{
+public:
+	stratified_sampler(const int samples_per_pixel, const uint32_t seed) : sampler(samples_per_pixel, seed)
+	{
+	}
+
+protected:
+	double sample_1d(const int d) override
+	{
+		const uint32_t dim_seed = dimension_seed(d);
+		const uint32_t n = static_cast<uint32_t>(samples_per_pixel);
+		const uint32_t stratum = permutation_element(static_cast<uint32_t>(index) % n, n, dim_seed);
+		const double jitter = bits_to_unit_double(hash_values(dim_seed, static_cast<uint64_t>(index)));
+		return (stratum + jitter) / n;
+	}
+
+	sample2 sample_2d(const int d) override
+	{
+		const uint32_t dim_seed = dimension_seed(d);
+		const uint32_t n = static_cast<uint32_t>(samples_per_pixel);
+		const auto m = static_cast<uint32_t>(std::sqrt(static_cast<double>(n)));
+		const uint32_t rows = (n + m - 1) / m;
+
+		const uint32_t s = permutation_element(static_cast<uint32_t>(index) % n, n, dim_seed * 0x51633e2d);
+		const uint32_t sx = permutation_element(s % m, m, dim_seed * 0x68bc21eb);
+		const uint32_t sy = permutation_element(s / m, rows, dim_seed * 0x02e5be93);
+		const double jx = bits_to_unit_double(hash_values(dim_seed, s, 0x967a889b));
+		const double jy = bits_to_unit_double(hash_values(dim_seed, s, 0x368cc8b7));
+
+		const double x = (sx + (sy + jx) / rows) / m;
+		const double y = (s + jy) / n;
+		return {x < 1 ? x : std::nextafter(1.0, 0.0), y};
+	}
+};
+
+// Owen-scrambled Sobol points. Every dimension (pair) reuses the first two Sobol dimensions
+// with its own scramble and its own shuffle of the sample order, which keeps the excellent 2D
+// stratification of those dimensions without correlating the pixel, the lens and the bounces.
+// Converges best when samples_per_pixel is a power of two.
+class sobol_sampler : public sampler
+{
+public:
+	sobol_sampler(const int samples_per_pixel, const uint32_t seed) : sampler(samples_per_pixel, seed)
+	{
+	}
+
+protected:
+	double sample_1d(const int d) override
+	{
+		const uint32_t dim_seed = dimension_seed(d);
+		const uint32_t i = shuffled_index(dim_seed);
+		return bits_to_unit_double(owen_scramble(sobol_0(i), static_cast<uint32_t>(hash_values(dim_seed, 1))));
+	}
+
+	sample2 sample_2d(const int d) override
+	{
+		const uint32_t dim_seed = dimension_seed(d);
+		const uint32_t i = shuffled_index(dim_seed);
+		return {
+			bits_to_unit_double(owen_scramble(sobol_0(i), static_cast<uint32_t>(hash_values(dim_seed, 1)))),
+			bits_to_unit_double(owen_scramble(sobol_1(i), static_cast<uint32_t>(hash_values(dim_seed, 2))))
+		};
+	}
+
+private:
+	uint32_t shuffled_index(const uint32_t dim_seed) const
+	{
+		// Shuffle within the power-of-two block holding the sample, which keeps each complete
+		// block of the sequence together.
+		uint32_t n = 1;
+		while (n < static_cast<uint32_t>(samples_per_pixel) && n < (1u << 31))
+			n <<= 1;
+		const auto i = static_cast<uint32_t>(index);
+		return (i & ~(n - 1)) | permutation_element(i & (n - 1), n, dim_seed);
+	}
+
+	static uint32_t sobol_0(uint32_t i)
+	{
+		// The first Sobol dimension is the van der Corput sequence.
+		return reverse_bits(i);
+	}
+
+	static uint32_t sobol_1(uint32_t i)
+	{
+		uint32_t r = 0;
+		for (uint32_t v = 1u << 31; i; i >>= 1, v ^= v >> 1)
+		{
+			if (i & 1)
+				r ^= v;
+		}
+		return r;
+	}
+
+	static uint32_t owen_scramble(uint32_t v, const uint32_t seed)
+	{
+		// Hash-based nested uniform scramble (Laine and Karras 2011, constants from pbrt-v4):
+		// each bit is flipped depending only on the bits above it.
+		v = reverse_bits(v);
+		v ^= v * 0x3d20adea;
+		v += seed;
+		v *= (seed >> 16) | 1;
+		v ^= v * 0x05526c56;
+		v ^= v * 0x53a22864;
+		return reverse_bits(v);
+	}
+};
+
+// Halton points with Owen-scrambled digits. Dimension d uses the d-th prime as its base, and
+// every pixel scrambles its own copy of the sequence.
+class halton_sampler : public sampler
+{
+public:
+	halton_sampler(const int samples_per_pixel, const uint32_t seed) : sampler(samples_per_pixel, seed)
+	{
+	}
+
+protected:
+	double sample_1d(const int d) override
+	{
+		return scrambled_radical_inverse(prime(d), static_cast<uint64_t>(index), dimension_seed(d));
+	}
+
+	sample2 sample_2d(const int d) override
+	{
+		return {sample_1d(d), sample_1d(d + 1)};
+	}
+
+private:
+	static uint32_t prime(const int n)
+	{
+		static const std::vector<uint32_t> primes = []
+		{
+			std::vector<uint32_t> p;
+			for (uint32_t candidate = 2; p.size() < 1024; candidate++)
+			{
+				bool is_prime = true;
+				for (const auto q : p)
+				{
+					if (q * q > candidate)
+						break;
+					if (candidate % q == 0)
+					{
+						is_prime = false;
+						break;
+					}
+				}
+				if (is_prime)
+					p.push_back(candidate);
+			}
+			return p;
+		}();
+		return primes[static_cast<size_t>(n) % primes.size()];
+	}
+
+	static double scrambled_radical_inverse(const uint32_t base, uint64_t a, const uint32_t seed)
+	{
+		// Mirror the digits of a around the radix point, permuting each digit with a permutation
+		// that depends on the digits before it. Digits are generated to 2^-32 resolution.
+		const double inv_base = 1.0 / base;
+		double inv_base_m = 1;
+		uint64_t reversed_digits = 0;
+		while (inv_base_m > 0x1p-32)
+		{
+			const uint64_t next = a / base;
+			const auto digit = static_cast<uint32_t>(a - next * base);
+			const auto digit_seed = static_cast<uint32_t>(mix_bits(seed ^ reversed_digits));
+			reversed_digits = reversed_digits * base + permutation_element(digit, base, digit_seed);
+			inv_base_m *= inv_base;
+			a = next;
+		}
+		const double x = inv_base_m * reversed_digits;
+		return x < 1 ? x : std::nextafter(1.0, 0.0);
+	}
+};
+
+enum class sampler_type
+{
+	independent,
+	stratified,
+	sobol,
+	halton
+};
+
+inline std::unique_ptr<sampler> make_sampler(const sampler_type type, const int samples_per_pixel, const uint32_t seed)
+{
+	switch (type)
+	{
+	case sampler_type::independent: return std::make_unique<independent_sampler>(samples_per_pixel, seed);
+	case sampler_type::stratified: return std::make_unique<stratified_sampler>(samples_per_pixel, seed);
+	case sampler_type::halton: return std::make_unique<halton_sampler>(samples_per_pixel, seed);
+	case sampler_type::sobol:
+	default: return std::make_unique<sobol_sampler>(samples_per_pixel, seed);
+	}
+}
+
+#endif
@@ -2,18 +2,44 @@
 #define SPHERE_H
 
 #include "hittable.h"
+#include "material_base.h"
 
-class sphere : public hittable
+class sphere final : public hittable
 {
 public:
+	// Stationary sphere
 	sphere(const vec3& center, const double radius, shared_ptr<material> mat)
 		: center(center), radius(fmax(0, radius)), mat(mat)
 	{
+		const auto rvec = vec3(radius, radius, radius);
+		bbox = aabb(center - rvec, center + rvec);
 	}
 
+	// Moving sphere, at center1 at time 0 and at center2 at time 1
+	sphere(const vec3& center1, const vec3& center2, const double radius, shared_ptr<material> mat)
+		: center(center1), velocity(center2 - center1), radius(fmax(0, radius)), mat(mat)
+	{
+		const auto rvec = vec3(radius, radius, radius);
+		bbox = aabb(aabb(center1 - rvec, center1 + rvec), aabb(center2 - rvec, center2 + rvec));
+	}
+
+	// Moves or resizes the sphere in place, for animation. A bvh_list holding it must be told
+	// through update() before the next frame.
+	void place(const vec3& center1, const vec3& center2, const double new_radius)
+	{
+		center = center1;
+		velocity = center2 - center1;
+		radius = fmax(0, new_radius);
+		const auto rvec = vec3(radius, radius, radius);
+		bbox = aabb(aabb(center1 - rvec, center1 + rvec), aabb(center2 - rvec, center2 + rvec));
+	}
+
+	void place(const vec3& new_center, const double new_radius) { place(new_center, new_center, new_radius); }
+
 	bool hit(const ray& r, const interval ray_t, hit_record& rec) const override
 	{
-		const vec3 oc = center - r.origin();
+		const vec3 current_center = center + r.time() * velocity;
+		const vec3 oc = current_center - r.origin();
 		const auto a = r.direction().length_squared();
 		const auto h = dot(r.direction(), oc);
 		const auto c = oc.length_squared() - radius * radius;
@@ -35,17 +61,65 @@ public:
 
 		rec.t = root;
 		rec.p = r.at(rec.t);
-		const vec3 outward_normal = (rec.p - center) / radius;
+		const vec3 outward_normal = (rec.p - current_center) / radius;
 		rec.set_face_normal(r, outward_normal);
-		rec.mat = mat;
+		get_sphere_uv(outward_normal, rec.u, rec.v);
+		rec.uv_per_length = 1 / (pi * radius);
+		rec.mat = mat.get();
 
 		return true;
 	}
 
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		const vec3 current_center = center + r.time() * velocity;
+		const vec3 oc = current_center - r.origin();
+		const auto a = r.direction().length_squared();
+		const auto h = dot(r.direction(), oc);
+		const auto c = oc.length_squared() - radius * radius;
+
+		const auto discriminant = h * h - a * c;
+		if (discriminant < 0)
+			return false;
+
+		// Either root inside the range blocks the ray, no need to order them.
+		const auto sqrtd = sqrt(discriminant);
+		return ray_t.surrounds((h - sqrtd) / a) || ray_t.surrounds((h + sqrtd) / a);
+	}
+
+	aabb bounding_box() const override { return bbox; }
+
+	void motion_bounds(aabb& start, aabb& end) const override
+	{
+		const auto rvec = vec3(radius, radius, radius);
+		start = aabb(center - rvec, center + rvec);
+		end = start + velocity;
+	}
+
+	void account(memory_report& report) const override
+	{
+		report.add("primitive: sphere", sizeof(*this));
+		report.add_shared(mat.get());
+	}
+
 private:
-	vec3 center;
+	vec3 center; // At time 0
+	vec3 velocity; // Distance moved by time 1
 	double radius;
 	shared_ptr<material> mat;
+	aabb bbox;
+
+	static void get_sphere_uv(const vec3& p, double& u, double& v)
+	{
+		// p: a given point on the sphere of radius one, centered at the origin.
+		// u: returned value [0,1] of angle around the Y axis from X=-1.
+		// v: returned value [0,1] of angle from Y=-1 to Y=+1.
+		const auto theta = acos(-p.y());
+		const auto phi = atan2(-p.z(), p.x()) + pi;
+
+		u = phi / (2 * pi);
+		v = theta / pi;
+	}
 };
 
 #endif
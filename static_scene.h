@@ -0,0 +1,71 @@
+#ifndef STATIC_SCENE_H
+#define STATIC_SCENE_H
+
+#include "hittable.h"
+
+#include <tuple>
+#include <utility>
+
+// A scene whose primitive types are fixed at compile time. The primitives are stored by value
+// in a tuple and visited by fold expressions, so hit() is an unrolled sequence of direct,
+// inlinable calls instead of a loop of virtual calls through shared_ptrs. Useful for fixed
+// scenes; the primitive types should be `final` so their own calls are devirtualized too.
+//
+//     static_scene scene(plane(...), sphere(...), sphere(...));
+template <typename... Primitives>
+class static_scene final : public hittable
+{
+public:
+	explicit static_scene(Primitives... primitives) : primitives(std::move(primitives)...)
+	{
+		std::apply([&](const Primitives&... p) { ((bbox = aabb(bbox, p.bounding_box())), ...); }, this->primitives);
+	}
+
+	bool hit(const ray& r, const interval ray_t, hit_record& rec) const override
+	{
+		return std::apply([&](const Primitives&... p)
+		{
+			hit_record temp_rec;
+			bool hit_anything = false;
+			auto closest_so_far = ray_t.max;
+
+			auto hit_one = [&](const auto& primitive)
+			{
+				if (primitive.hit(r, interval(ray_t.min, closest_so_far), temp_rec))
+				{
+					hit_anything = true;
+					closest_so_far = temp_rec.t;
+					rec = temp_rec;
+				}
+			};
+			(hit_one(p), ...);
+
+			return hit_anything;
+		}, primitives);
+	}
+
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		return std::apply([&](const Primitives&... p) { return (p.occluded(r, ray_t) || ...); }, primitives);
+	}
+
+	aabb bounding_box() const override { return bbox; }
+
+	void account(memory_report& report) const override
+	{
+		// The primitives account for their own part of the tuple.
+		report.add("scene: static_scene", sizeof(*this) - (sizeof(Primitives) + ... + 0));
+		std::apply([&](const Primitives&... p) { (p.account(report), ...); }, primitives);
+	}
+
+	void compact() override
+	{
+		std::apply([&](Primitives&... p) { (p.compact(), ...); }, primitives);
+	}
+
+private:
+	std::tuple<Primitives...> primitives;
+	aabb bbox;
+};
+
+#endif
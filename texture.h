@@ -0,0 +1,93 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "hittable.h"
+#include "texture_cache.h"
+
+class texture
+{
+public:
+	virtual ~texture() = default;
+
+	virtual color value(const hit_record& rec) const = 0;
+
+	virtual void account(memory_report& report) const = 0;
+};
+
+class solid_color final : public texture
+{
+public:
+	solid_color(const color& albedo) : albedo(albedo)
+	{
+	}
+
+	color value(const hit_record& rec) const override { return albedo; }
+
+	void account(memory_report& report) const override { report.add("texture: solid_color", sizeof(*this)); }
+
+private:
+	color albedo;
+};
+
+// An image from a texture_cache, repeated across the surface's u, v. The mip level follows the
+// width of the ray's footprint in texels, and trilinear filtering blends the two nearest levels,
+// so distant or indirectly seen surfaces neither alias nor pull in detail nobody will see.
+class image_texture final : public texture
+{
+public:
+	image_texture(shared_ptr<texture_cache> cache, const int id) : cache(cache), id(id)
+	{
+	}
+
+	color value(const hit_record& rec) const override
+	{
+		const std::vector<texture_cache::mip_level>& levels = cache->levels(id);
+		const double texels = rec.footprint * rec.uv_per_length * levels[0].width;
+		const double lod = texels > 1 ? fmin(log2(texels), static_cast<double>(levels.size() - 1)) : 0.0;
+		const int level = static_cast<int>(lod);
+		const double blend = lod - level;
+
+		// Image rows run down while v runs up.
+		const double u = rec.u - floor(rec.u);
+		const double v = 1.0 - (rec.v - floor(rec.v));
+
+		texture_cache::reader reader(*cache);
+		const color fine = bilinear(reader, level, u, v);
+		if (blend <= 0)
+			return fine;
+		return (1 - blend) * fine + blend * bilinear(reader, level + 1, u, v);
+	}
+
+	void account(memory_report& report) const override
+	{
+		report.add("texture: image_texture", sizeof(*this));
+		report.add_shared(cache.get());
+	}
+
+private:
+	shared_ptr<texture_cache> cache;
+	int id;
+
+	color bilinear(texture_cache::reader& reader, const int level, const double u, const double v) const
+	{
+		const texture_cache::mip_level& l = cache->levels(id)[level];
+		const double x = u * l.width - 0.5;
+		const double y = v * l.height - 0.5;
+		const int x0 = static_cast<int>(floor(x));
+		const int y0 = static_cast<int>(floor(y));
+		const double fx = x - x0;
+		const double fy = y - y0;
+
+		auto wrap = [](const int i, const int n) { return i < 0 ? i + n : i >= n ? i - n : i; };
+		auto fetch = [&](const int tx, const int ty)
+		{
+			const float* t = reader.texel(id, level, wrap(tx, l.width), wrap(ty, l.height));
+			return color(t[0], t[1], t[2]);
+		};
+
+		return (1 - fy) * ((1 - fx) * fetch(x0, y0) + fx * fetch(x0 + 1, y0))
+			+ fy * ((1 - fx) * fetch(x0, y0 + 1) + fx * fetch(x0 + 1, y0 + 1));
+	}
+};
+
+#endif
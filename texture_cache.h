@@ -0,0 +1,428 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "image_io.h"
+#include "memory_report.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Image textures live on disk as tiled, mip-mapped files: every mip level is cut into square
+// tiles of tile_size texels, stored one after another, so any tile can be read on its own.
+// Source images (.hdr, .ppm) are converted once into "<source>.tiles" next to them.
+
+namespace texture_detail
+{
+	constexpr uint32_t tiled_magic = 0x58545452; // "RTTX"
+	constexpr uint32_t tiled_version = 1;
+	constexpr int tile_size = 64;
+	constexpr size_t tile_floats = 3 * tile_size * tile_size;
+	constexpr size_t tile_bytes = sizeof(float) * tile_floats;
+	constexpr std::streamoff header_bytes = 4 * sizeof(uint32_t);
+
+	struct mip_level
+	{
+		int width, height;
+		int tiles_x, tiles_y;
+		uint64_t first_tile; // Index of its first tile in the file
+	};
+
+	// Level 0 is the image itself; each further level halves it, down to a single texel.
+	inline std::vector<mip_level> mip_chain(int width, int height)
+	{
+		std::vector<mip_level> levels;
+		uint64_t tiles = 0;
+		while (true)
+		{
+			const int tiles_x = (width + tile_size - 1) / tile_size;
+			const int tiles_y = (height + tile_size - 1) / tile_size;
+			levels.push_back({width, height, tiles_x, tiles_y, tiles});
+			tiles += static_cast<uint64_t>(tiles_x) * tiles_y;
+			if (width == 1 && height == 1)
+				return levels;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+	}
+
+	// 2x2 box filter; a leftover odd row or column is folded into the last texel.
+	inline float_image downsample(const float_image& image, const int width, const int height)
+	{
+		float_image half;
+		half.width = width;
+		half.height = height;
+		half.rgb.assign(3 * static_cast<size_t>(width) * height, 0.0f);
+		for (int y = 0; y < image.height; y++)
+		{
+			const int hy = std::min(y / 2, height - 1);
+			for (int x = 0; x < image.width; x++)
+			{
+				const int hx = std::min(x / 2, width - 1);
+				const float* t = image.texel(x, y);
+				float* h = &half.rgb[3 * (static_cast<size_t>(hy) * width + hx)];
+				for (int c = 0; c < 3; c++)
+					h[c] += t[c];
+			}
+		}
+
+		// Divide by the number of source texels each one gathered.
+		for (int hy = 0; hy < height; hy++)
+		{
+			const int rows = hy == height - 1 ? image.height - 2 * hy : 2;
+			for (int hx = 0; hx < width; hx++)
+			{
+				const int columns = hx == width - 1 ? image.width - 2 * hx : 2;
+				float* h = &half.rgb[3 * (static_cast<size_t>(hy) * width + hx)];
+				for (int c = 0; c < 3; c++)
+					h[c] /= static_cast<float>(rows * columns);
+			}
+		}
+		return half;
+	}
+
+	inline bool write_tiled_texture(float_image image, const std::string& path)
+	{
+		// Write to a temporary file first, so an interrupted conversion is never mistaken for a
+		// finished one.
+		const std::string temporary = path + ".tmp";
+		{
+			std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+			const uint32_t header[] = {
+				tiled_magic, tiled_version, static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height)
+			};
+			out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+			std::vector<float> tile(tile_floats);
+			const std::vector<mip_level> levels = mip_chain(image.width, image.height);
+			for (size_t l = 0; l < levels.size(); l++)
+			{
+				const mip_level& level = levels[l];
+				if (l > 0)
+					image = downsample(image, level.width, level.height);
+
+				for (int ty = 0; ty < level.tiles_y; ty++)
+				{
+					for (int tx = 0; tx < level.tiles_x; tx++)
+					{
+						// Tiles over the edge of the level are padded with its last texels.
+						for (int y = 0; y < tile_size; y++)
+						{
+							const int sy = std::min(ty * tile_size + y, level.height - 1);
+							for (int x = 0; x < tile_size; x++)
+							{
+								const int sx = std::min(tx * tile_size + x, level.width - 1);
+								std::copy_n(image.texel(sx, sy), 3, &tile[3 * (y * tile_size + x)]);
+							}
+						}
+						out.write(reinterpret_cast<const char*>(tile.data()), tile_bytes);
+					}
+				}
+			}
+			if (!out)
+			{
+				std::cerr << "Failed to write tiled texture " << temporary << "\n";
+				return false;
+			}
+		}
+
+		std::remove(path.c_str());
+		if (std::rename(temporary.c_str(), path.c_str()) != 0)
+		{
+			std::cerr << "Failed to replace tiled texture " << path << "\n";
+			return false;
+		}
+		return true;
+	}
+}
+
+// Texture tiles in a fixed memory budget, shared by all render threads. The cache has a fixed
+// number of slots, each holding one tile; a tile that isn't in a slot is read from its file.
+//
+// Reads don't lock: every texture has a table from tile to slot, and a reader pins the slot by
+// counting itself in, then checks the slot still holds its tile. Misses take a lock, pick the
+// least recently used slot no reader has pinned, wait for readers that pinned it before it was
+// claimed, and read the tile into it. Use is recorded as the number of misses so far, so in the
+// steady state hits write nothing shared.
+class texture_cache
+{
+public:
+	using mip_level = texture_detail::mip_level;
+	static constexpr int tile_size = texture_detail::tile_size;
+
+	// A budget too small for every hardware thread to pin a tile is raised to that minimum.
+	explicit texture_cache(const size_t budget_bytes)
+	{
+		set_budget(budget_bytes);
+	}
+
+	texture_cache(const texture_cache&) = delete;
+	texture_cache& operator=(const texture_cache&) = delete;
+
+	// Registers a texture and returns its id, or -1 after printing the reason. A source image is
+	// converted to a tiled file first, unless an up-to-date one exists. Textures must be added
+	// before rendering starts.
+	int add(const std::string& path)
+	{
+		using namespace texture_detail;
+
+		std::string tiled_path = path;
+		if (path.size() < 6 || path.compare(path.size() - 6, 6, ".tiles") != 0)
+		{
+			tiled_path = path + ".tiles";
+			std::error_code error;
+			const bool up_to_date = std::filesystem::exists(tiled_path, error)
+				&& std::filesystem::last_write_time(tiled_path, error) >= std::filesystem::last_write_time(path, error)
+				&& !error;
+			if (!up_to_date)
+			{
+				float_image image = load_image(path);
+				if (image.empty() || !write_tiled_texture(std::move(image), tiled_path))
+					return -1;
+			}
+		}
+
+		auto texture = std::make_unique<texture_file>();
+		texture->file.open(tiled_path, std::ios::binary);
+		uint32_t header[4];
+		if (!texture->file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != tiled_magic
+			|| header[1] != tiled_version || header[2] == 0 || header[3] == 0)
+		{
+			std::cerr << tiled_path << " is not a tiled texture\n";
+			return -1;
+		}
+
+		texture->levels = mip_chain(static_cast<int>(header[2]), static_cast<int>(header[3]));
+		const mip_level& last = texture->levels.back();
+		const uint64_t tile_count = last.first_tile + static_cast<uint64_t>(last.tiles_x) * last.tiles_y;
+		texture->tile_slots.reset(new std::atomic<int32_t>[tile_count]);
+		for (uint64_t t = 0; t < tile_count; t++)
+			texture->tile_slots[t].store(-1, std::memory_order_relaxed);
+
+		textures.push_back(std::move(texture));
+		return static_cast<int>(textures.size() - 1);
+	}
+
+	// Changes the budget, emptying the cache. Only before rendering starts or between frames.
+	void set_budget(const size_t budget_bytes)
+	{
+		const size_t minimum = 2 * static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency())) + 16;
+		slot_count = std::max(minimum, budget_bytes / texture_detail::tile_bytes);
+		slots.reset(new cache_slot[slot_count]);
+		allocated_slots = 0;
+		for (const auto& texture : textures)
+		{
+			const mip_level& last = texture->levels.back();
+			const uint64_t tile_count = last.first_tile + static_cast<uint64_t>(last.tiles_x) * last.tiles_y;
+			for (uint64_t t = 0; t < tile_count; t++)
+				texture->tile_slots[t].store(-1, std::memory_order_relaxed);
+		}
+	}
+
+	// Counts the whole budget, which a long enough render fills.
+	void account(memory_report& report) const
+	{
+		report.add("texture: tile cache", budget_bytes());
+		report.add("texture: cache slots", slot_count * sizeof(cache_slot), slot_count);
+		for (const auto& texture : textures)
+		{
+			const mip_level& last = texture->levels.back();
+			const uint64_t tile_count = last.first_tile + static_cast<uint64_t>(last.tiles_x) * last.tiles_y;
+			report.add("texture: tile tables",
+			           sizeof(texture_file) + vector_bytes(texture->levels) + tile_count * sizeof(std::atomic<int32_t>));
+		}
+	}
+
+	const std::vector<mip_level>& levels(const int texture) const { return textures[texture]->levels; }
+
+	size_t tiles_loaded() const { return loads.load(std::memory_order_relaxed); }
+	size_t resident_bytes() const { return allocated_slots * texture_detail::tile_bytes; }
+	size_t budget_bytes() const { return slot_count * texture_detail::tile_bytes; }
+
+	// Fetches texels for one thread, keeping the tile of the last one pinned so runs of nearby
+	// texels cost one cache lookup. It holds at most one pin, and never while waiting for the
+	// cache's lock, so use one per texture lookup and let it go soon after.
+	class reader
+	{
+	public:
+		explicit reader(texture_cache& cache) : cache(cache)
+		{
+		}
+
+		~reader()
+		{
+			release();
+		}
+
+		reader(const reader&) = delete;
+		reader& operator=(const reader&) = delete;
+
+		// RGB of texel (x, y) of a mip level; the coordinates must be inside the level.
+		const float* texel(const int texture, const int level, const int x, const int y)
+		{
+			const mip_level& l = cache.textures[texture]->levels[level];
+			const uint64_t tile = l.first_tile + static_cast<uint64_t>(y / tile_size) * l.tiles_x + x / tile_size;
+			const uint64_t key = static_cast<uint64_t>(texture) << tile_bits | tile;
+			if (key != pinned_key)
+			{
+				release();
+				pinned_slot = cache.pin(texture, tile, key);
+				pinned_key = key;
+			}
+			return cache.slots[pinned_slot].texels.get() + 3 * ((y % tile_size) * tile_size + x % tile_size);
+		}
+
+	private:
+		texture_cache& cache;
+		int32_t pinned_slot = -1;
+		uint64_t pinned_key = empty_key;
+
+		void release()
+		{
+			if (pinned_slot >= 0)
+				cache.slots[pinned_slot].readers.fetch_sub(1, std::memory_order_release);
+			pinned_slot = -1;
+			pinned_key = empty_key;
+		}
+	};
+
+private:
+	static constexpr uint64_t empty_key = ~0ull;
+	static constexpr int tile_bits = 40; // Keys are the texture id above the tile index
+
+	struct texture_file
+	{
+		std::ifstream file;
+		std::vector<mip_level> levels;
+		std::unique_ptr<std::atomic<int32_t>[]> tile_slots; // Slot holding each tile, -1 for none
+	};
+
+	// Slot bookkeeping is kept on its own cache line; the texels are allocated on first use.
+	struct alignas(64) cache_slot
+	{
+		std::atomic<uint64_t> key{empty_key};
+		std::atomic<uint32_t> readers{0};
+		std::atomic<uint64_t> last_use{0};
+		std::unique_ptr<float[]> texels;
+	};
+
+	std::vector<std::unique_ptr<texture_file>> textures;
+	std::unique_ptr<cache_slot[]> slots;
+	size_t slot_count = 0;
+	size_t allocated_slots = 0; // Slots with texels; the rest have never been used
+	std::atomic<uint64_t> clock{0}; // Misses so far, the time of last use
+	std::atomic<size_t> loads{0};
+	std::mutex load_mutex;
+
+	int32_t pin(const int texture, const uint64_t tile, const uint64_t key)
+	{
+		const int32_t slot = textures[texture]->tile_slots[tile].load(std::memory_order_acquire);
+		if (slot >= 0 && try_pin(slot, key))
+			return slot;
+		return load(texture, tile, key);
+	}
+
+	bool try_pin(const int32_t slot, const uint64_t key)
+	{
+		// Counting in before checking the key pairs with load() clearing the key before it
+		// checks the count: either this sees the slot is being reused, or load() sees this
+		// reader and waits for it.
+		cache_slot& s = slots[slot];
+		s.readers.fetch_add(1);
+		if (s.key.load() != key)
+		{
+			s.readers.fetch_sub(1, std::memory_order_release);
+			return false;
+		}
+
+		const uint64_t now = clock.load(std::memory_order_relaxed);
+		if (s.last_use.load(std::memory_order_relaxed) != now)
+			s.last_use.store(now, std::memory_order_relaxed);
+		return true;
+	}
+
+	int32_t load(const int texture, const uint64_t tile, const uint64_t key)
+	{
+		std::unique_lock<std::mutex> lock(load_mutex);
+		std::atomic<int32_t>& entry = textures[texture]->tile_slots[tile];
+
+		int32_t victim;
+		while (true)
+		{
+			// Another thread may have loaded the tile while this one waited for the lock.
+			const int32_t slot = entry.load(std::memory_order_acquire);
+			if (slot >= 0 && try_pin(slot, key))
+				return slot;
+
+			victim = least_recently_used();
+			if (victim >= 0)
+				break;
+
+			// Every slot is pinned; readers let go within one texture lookup.
+			lock.unlock();
+			std::this_thread::yield();
+			lock.lock();
+		}
+
+		cache_slot& s = slots[victim];
+		const uint64_t old_key = s.key.load();
+		s.key.store(empty_key);
+		if (old_key != empty_key)
+			textures[old_key >> tile_bits]->tile_slots[old_key & ((1ull << tile_bits) - 1)].store(-1, std::memory_order_relaxed);
+		while (s.readers.load() != 0)
+			std::this_thread::yield();
+
+		if (!s.texels)
+		{
+			s.texels = std::make_unique<float[]>(texture_detail::tile_floats);
+			allocated_slots++;
+		}
+
+		std::ifstream& file = textures[texture]->file;
+		file.seekg(texture_detail::header_bytes + static_cast<std::streamoff>(tile * texture_detail::tile_bytes));
+		if (!file.read(reinterpret_cast<char*>(s.texels.get()), texture_detail::tile_bytes))
+		{
+			std::cerr << "Failed to read texture tile " << tile << " of texture " << texture << "\n";
+			file.clear();
+			std::fill_n(s.texels.get(), texture_detail::tile_floats, 0.0f);
+		}
+
+		s.last_use.store(clock.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		s.readers.fetch_add(1);
+		s.key.store(key);
+		entry.store(victim, std::memory_order_release);
+		loads.fetch_add(1, std::memory_order_relaxed);
+		return victim;
+	}
+
+	// A never used slot if there is one, else the unpinned slot used longest ago, -1 if none.
+	int32_t least_recently_used() const
+	{
+		if (allocated_slots < slot_count)
+			return static_cast<int32_t>(allocated_slots);
+
+		int32_t best = -1;
+		uint64_t oldest = ~0ull;
+		for (size_t i = 0; i < slot_count; i++)
+		{
+			const cache_slot& s = slots[i];
+			const uint64_t used = s.last_use.load(std::memory_order_relaxed);
+			if (used < oldest && s.readers.load(std::memory_order_relaxed) == 0)
+			{
+				oldest = used;
+				best = static_cast<int32_t>(i);
+			}
+		}
+		return best;
+	}
+};
+
+#endif
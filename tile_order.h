@@ -0,0 +1,96 @@
+#ifndef TILE_ORDER_H
+#define TILE_ORDER_H
+
+#include <cstdint>
+#include <vector>
+
+// Order in which tiles, and pixels within a tile, are visited. Following a space-filling curve
+// keeps consecutive rays close together on screen, so they tend to touch the same BVH nodes and
+// primitives while those are still in cache.
+enum class tile_order
+{
+	scanline,
+	morton,
+	hilbert
+};
+
+struct grid_point
+{
+	uint16_t x, y;
+};
+
+inline uint32_t compact_bits(uint32_t v)
+{
+	// Keeps the even bits of v, packed together.
+	v &= 0x55555555;
+	v = (v | (v >> 1)) & 0x33333333;
+	v = (v | (v >> 2)) & 0x0f0f0f0f;
+	v = (v | (v >> 4)) & 0x00ff00ff;
+	v = (v | (v >> 8)) & 0x0000ffff;
+	return v;
+}
+
+// Position d along the Z-order curve.
+inline grid_point morton_point(const uint32_t d)
+{
+	return {static_cast<uint16_t>(compact_bits(d)), static_cast<uint16_t>(compact_bits(d >> 1))};
+}
+
+// Position d along the Hilbert curve filling an n x n grid, n a power of two.
+inline grid_point hilbert_point(const uint32_t n, uint32_t d)
+{
+	uint32_t x = 0, y = 0;
+	for (uint32_t s = 1; s < n; s *= 2)
+	{
+		const uint32_t rx = 1 & (d / 2);
+		const uint32_t ry = 1 & (d ^ rx);
+		if (ry == 0)
+		{
+			// Rotate the quadrant.
+			if (rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			const uint32_t t = x;
+			x = y;
+			y = t;
+		}
+		x += s * rx;
+		y += s * ry;
+		d /= 4;
+	}
+	return {static_cast<uint16_t>(x), static_cast<uint16_t>(y)};
+}
+
+// Every point of a width x height grid, in the given order. The curves are walked over the
+// enclosing power-of-two square, skipping points that fall outside the grid.
+inline std::vector<grid_point> grid_order(const tile_order order, const int width, const int height)
+{
+	std::vector<grid_point> points;
+	points.reserve(static_cast<size_t>(width) * height);
+
+	if (order == tile_order::scanline)
+	{
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+				points.push_back({static_cast<uint16_t>(x), static_cast<uint16_t>(y)});
+		}
+		return points;
+	}
+
+	uint32_t n = 1;
+	while (n < static_cast<uint32_t>(width) || n < static_cast<uint32_t>(height))
+		n *= 2;
+
+	for (uint32_t d = 0; d < n * n; d++)
+	{
+		const grid_point p = order == tile_order::morton ? morton_point(d) : hilbert_point(n, d);
+		if (p.x < width && p.y < height)
+			points.push_back(p);
+	}
+	return points;
+}
+
+#endif
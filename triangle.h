@@ -0,0 +1,82 @@
+#ifndef TRIANGLE_H
+#define TRIANGLE_H
+
+#include "hittable.h"
+#include "material_base.h"
+
+// A single triangle, for scenes with a few of them; triangle_mesh is the one for many. Its u, v
+// are the barycentric coordinates of v1 and v2.
+class triangle final : public hittable
+{
+public:
+	triangle(const vec3& v0, const vec3& v1, const vec3& v2, shared_ptr<material> mat)
+		: v0(v0), e1(v1 - v0), e2(v2 - v0), mat(mat)
+	{
+		normal = unit_vector(cross(e1, e2));
+		bbox = aabb(aabb(v0, v1), aabb(v2, v2));
+		uv_per_length = 1 / fmin(e1.length(), e2.length());
+	}
+
+	bool hit(const ray& r, const interval ray_t, hit_record& rec) const override
+	{
+		double t, b1, b2;
+		if (!intersect(r, ray_t, t, b1, b2))
+			return false;
+
+		rec.t = t;
+		rec.p = r.at(t);
+		rec.set_face_normal(r, normal);
+		rec.u = b1;
+		rec.v = b2;
+		rec.uv_per_length = uv_per_length;
+		rec.mat = mat.get();
+		return true;
+	}
+
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		double t, b1, b2;
+		return intersect(r, ray_t, t, b1, b2);
+	}
+
+	aabb bounding_box() const override { return bbox; }
+
+	void account(memory_report& report) const override
+	{
+		report.add("primitive: triangle", sizeof(*this));
+		report.add_shared(mat.get());
+	}
+
+private:
+	vec3 v0;
+	vec3 e1, e2; // Edges from v0
+	vec3 normal;
+	shared_ptr<material> mat;
+	aabb bbox;
+	double uv_per_length;
+
+	// Moller-Trumbore: solves for t and the barycentrics directly, rejecting as early as it can.
+	bool intersect(const ray& r, const interval& ray_t, double& t, double& b1, double& b2) const
+	{
+		const vec3 p = cross(r.direction(), e2);
+		const double det = dot(e1, p);
+		if (fabs(det) < 1e-12)
+			return false;
+		const double inv_det = 1 / det;
+
+		const vec3 s = r.origin() - v0;
+		b1 = dot(s, p) * inv_det;
+		if (b1 < 0 || b1 > 1)
+			return false;
+
+		const vec3 q = cross(s, e1);
+		b2 = dot(r.direction(), q) * inv_det;
+		if (b2 < 0 || b1 + b2 > 1)
+			return false;
+
+		t = dot(e2, q) * inv_det;
+		return ray_t.surrounds(t);
+	}
+};
+
+#endif
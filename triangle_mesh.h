@@ -0,0 +1,206 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "hittable.h"
+#include "bvh_wide.h"
+#include "material_base.h"
+
+#include <cstdint>
+#include <vector>
+
+class triangle_mesh final : public hittable
+{
+public:
+	// `positions` holds one xyz triple per vertex and `indices` three vertex indices per triangle.
+	// Both buffers are owned by the mesh; triangles are reordered to match the BVH leaf order.
+	triangle_mesh(std::vector<float> positions, std::vector<uint32_t> indices, shared_ptr<material> mat)
+		: positions(std::move(positions)), indices(std::move(indices)), mat(mat)
+	{
+		build_bvh();
+	}
+
+	// Moves the vertices, for deforming meshes; the triangles stay the same. The tree is refitted,
+	// or rebuilt if the new shape has made it much worse than a fresh build.
+	void set_positions(std::vector<float> new_positions)
+	{
+		positions = std::move(new_positions);
+		if (tree.empty())
+		{
+			build_bvh();
+			return;
+		}
+		tree.refit_all([&](const uint32_t triangle, bvh_bounds& start, bvh_bounds& end)
+		{
+			start = triangle_bounds(triangle);
+			end = start;
+		});
+		if (tree.needs_rebuild())
+			build_bvh();
+		else
+		{
+			wide.collapse(tree);
+			bbox = tree.bounding_box();
+		}
+	}
+
+	size_t vertex_count() const { return positions.size() / 3; }
+	size_t triangle_count() const { return indices.size() / 3; }
+
+	aabb bounding_box() const override { return bbox; }
+
+	bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+	{
+		const watertight_ray wr(r);
+		uint32_t closest_triangle = 0;
+
+		const bool hit_anything = wide.closest_hit(r, ray_t, [&](const uint32_t triangle, interval& t)
+		{
+			double t_hit;
+			if (!intersect(wr, triangle, t, t_hit))
+				return false;
+			t.max = t_hit;
+			ray_t.max = t_hit;
+			closest_triangle = triangle;
+			return true;
+		});
+
+		if (!hit_anything)
+			return false;
+
+		rec.t = ray_t.max;
+		rec.p = r.at(rec.t);
+		const vec3 v0 = vertex(indices[3 * closest_triangle]);
+		const vec3 v1 = vertex(indices[3 * closest_triangle + 1]);
+		const vec3 v2 = vertex(indices[3 * closest_triangle + 2]);
+		rec.set_face_normal(r, unit_vector(cross(v1 - v0, v2 - v0)));
+		rec.mat = mat.get(); // Meshes have no texture coordinates; u, v stay 0
+
+		return true;
+	}
+
+	bool occluded(const ray& r, const interval ray_t) const override
+	{
+		const watertight_ray wr(r);
+		return wide.any_hit(r, ray_t, [&](const uint32_t triangle, const interval& t)
+		{
+			double t_hit;
+			return intersect(wr, triangle, t, t_hit);
+		});
+	}
+
+	void account(memory_report& report) const override
+	{
+		report.add("primitive: triangle_mesh", sizeof(*this) + vector_bytes(positions) + vector_bytes(indices));
+		report.add("acceleration: bvh", tree.memory_bytes() + wide.memory_bytes());
+		report.add_shared(mat.get());
+	}
+
+	// The binary tree is only kept for refitting; tracing uses the wide one.
+	void compact() override { tree.release(); }
+
+private:
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+	bvh_tree tree; // Kept for refitting
+	bvh_wide<4> wide; // Collapsed from the tree, for tracing
+	aabb bbox;
+	shared_ptr<material> mat;
+
+	// Per-ray setup of the watertight ray/triangle test (Woop, Benthin and Wald 2013): the ray
+	// direction is permuted so its largest component is z, and vertices are sheared into a
+	// space where the ray runs along +z from the origin.
+	struct watertight_ray
+	{
+		vec3 origin;
+		int kx, ky, kz;
+		double sx, sy, sz;
+
+		explicit watertight_ray(const ray& r) : origin(r.origin())
+		{
+			const vec3& d = r.direction();
+			kz = fabs(d[0]) > fabs(d[1]) ? (fabs(d[0]) > fabs(d[2]) ? 0 : 2) : (fabs(d[1]) > fabs(d[2]) ? 1 : 2);
+			kx = (kz + 1) % 3;
+			ky = (kx + 1) % 3;
+
+			// Swap to preserve the winding direction of triangles.
+			if (d[kz] < 0)
+				std::swap(kx, ky);
+
+			sx = d[kx] / d[kz];
+			sy = d[ky] / d[kz];
+			sz = 1.0 / d[kz];
+		}
+	};
+
+	vec3 vertex(const uint32_t index) const
+	{
+		const float* p = &positions[3 * static_cast<size_t>(index)];
+		return vec3(p[0], p[1], p[2]);
+	}
+
+	bool intersect(const watertight_ray& wr, const uint32_t triangle, const interval& ray_t, double& t) const
+	{
+		const vec3 a = vertex(indices[3 * triangle]) - wr.origin;
+		const vec3 b = vertex(indices[3 * triangle + 1]) - wr.origin;
+		const vec3 c = vertex(indices[3 * triangle + 2]) - wr.origin;
+
+		const double ax = a[wr.kx] - wr.sx * a[wr.kz];
+		const double ay = a[wr.ky] - wr.sy * a[wr.kz];
+		const double bx = b[wr.kx] - wr.sx * b[wr.kz];
+		const double by = b[wr.ky] - wr.sy * b[wr.kz];
+		const double cx = c[wr.kx] - wr.sx * c[wr.kz];
+		const double cy = c[wr.ky] - wr.sy * c[wr.kz];
+
+		// Scaled barycentric coordinates; the ray passes inside when none has the opposite sign of
+		// another. Zero counts as inside, so a ray can't slip between two triangles sharing an
+		// edge; one along the edge itself hits both.
+		const double u = cx * by - cy * bx;
+		const double v = ax * cy - ay * cx;
+		const double w = bx * ay - by * ax;
+		if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+			return false;
+
+		const double det = u + v + w;
+		if (det == 0)
+			return false;
+
+		const double t_scaled = u * (wr.sz * a[wr.kz]) + v * (wr.sz * b[wr.kz]) + w * (wr.sz * c[wr.kz]);
+		t = t_scaled / det;
+		return ray_t.surrounds(t);
+	}
+
+	bvh_bounds triangle_bounds(const size_t triangle) const
+	{
+		bvh_bounds bounds;
+		for (int k = 0; k < 3; k++)
+			bounds.grow(&positions[3 * static_cast<size_t>(indices[3 * triangle + k])]);
+		return bounds;
+	}
+
+	void build_bvh()
+	{
+		const size_t count = triangle_count();
+		std::vector<bvh_bounds> bounds(count);
+		for (size_t i = 0; i < count; i++)
+			bounds[i] = triangle_bounds(i);
+		tree.build(bounds);
+
+		// Store triangles in leaf order, so leaves address them directly and the tree does not
+		// need to keep its index permutation around.
+		std::vector<uint32_t> ordered(indices.size());
+		for (size_t i = 0; i < count; i++)
+		{
+			const size_t source = tree.indices[i];
+			ordered[3 * i] = indices[3 * source];
+			ordered[3 * i + 1] = indices[3 * source + 1];
+			ordered[3 * i + 2] = indices[3 * source + 2];
+		}
+		indices.swap(ordered);
+		tree.indices.clear();
+		tree.indices.shrink_to_fit();
+		wide.collapse(tree);
+		bbox = tree.bounding_box();
+	}
+};
+
+#endif
@@ -28,8 +28,10 @@ inline double degrees_to_radians(const double degrees)
 
 inline double random_double()
 {
-	// Returns a random real in [0,1).
-	return rand() / (RAND_MAX + 1.0);
+	// Returns a random real in [0,1). Each thread has its own fixed-seed generator, so calls
+	// from different threads neither race nor disturb each other's sequences.
+	thread_local std::mt19937_64 generator(5489u);
+	return static_cast<double>(generator() >> 11) * 0x1p-53;
 }
 
 inline double random_double(const double min, const double max)
@@ -127,37 +127,65 @@ inline vec3 unit_vector(const vec3& v)
 	return v / v.length();
 }
 
+// Closed-form mappings from sample values in [0,1) to the distributions used for scattering
+// and depth of field. They are straight-line code with a fixed number of inputs, so they keep
+// the stratification of a sampler and map well to SIMD lanes.
+
+inline vec3 sample_unit_disk(const double u1, const double u2)
+{
+	// Uniform point in the unit disk (z = 0), by Shirley and Chiu's concentric mapping of the
+	// square onto the disk. The two wedge cases are selected rather than branched on.
+	const auto a = 2 * u1 - 1;
+	const auto b = 2 * u2 - 1;
+	const bool horizontal = a * a > b * b;
+	const auto r = horizontal ? a : b;
+	const auto phi = horizontal ? (pi / 4) * (b / a) : (pi / 2) - (pi / 4) * (a / (b != 0 ? b : 1));
+	return vec3(r * cos(phi), r * sin(phi), 0);
+}
+
+inline vec3 sample_unit_vector(const double u1, const double u2)
+{
+	// Uniform direction on the unit sphere, from spherical coordinates with z uniform in [-1,1].
+	const auto z = 1 - 2 * u1;
+	const auto r = sqrt(fmax(0.0, 1 - z * z));
+	const auto phi = 2 * pi * u2;
+	return vec3(r * cos(phi), r * sin(phi), z);
+}
+
+inline vec3 sample_unit_sphere(const double u1, const double u2, const double u3)
+{
+	// Uniform point inside the unit sphere: a uniform direction scaled by the cube root of u3.
+	return cbrt(u3) * sample_unit_vector(u1, u2);
+}
+
+inline vec3 sample_cosine_direction(const double u1, const double u2)
+{
+	// Cosine-weighted direction around +z (Malley's method): lift a uniform disk point onto
+	// the hemisphere.
+	const vec3 d = sample_unit_disk(u1, u2);
+	return vec3(d.x(), d.y(), sqrt(fmax(0.0, 1 - d.x() * d.x() - d.y() * d.y())));
+}
+
 inline vec3 random_in_unit_disk()
 {
-	while (true)
-	{
-		auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
-		if (p.length_squared() < 1)
-			return p;
-	}
+	return sample_unit_disk(random_double(), random_double());
 }
 
 inline vec3 random_in_unit_sphere()
 {
-	while (true)
-	{
-		auto p = vec3::random(-1, 1);
-		if (p.length_squared() < 1)
-			return p;
-	}
+	return sample_unit_sphere(random_double(), random_double(), random_double());
 }
 
 inline vec3 random_unit_vector()
 {
-	return unit_vector(random_in_unit_sphere());
+	return sample_unit_vector(random_double(), random_double());
 }
 
 inline vec3 random_on_hemisphere(const vec3& normal)
 {
+	// Flip into the normal's hemisphere by sign instead of a branch.
 	const vec3 on_unit_sphere = random_unit_vector();
-	if (dot(on_unit_sphere, normal) > 0.0) // In the same hemisphere as the normal
-		return on_unit_sphere;
-	return -on_unit_sphere;
+	return std::copysign(1.0, dot(on_unit_sphere, normal)) * on_unit_sphere;
 }
 
 inline vec3 reflect(const vec3& v, const vec3& n)